@@ -13,7 +13,8 @@ public:
         IMAP,
         FTP,
         HTTP,
-        SAMBA
+        SAMBA,
+        TASK
     };
 
     CollectedData() = delete;
@@ -5,6 +5,7 @@
 #include "smtp/data_processor.hpp"
 #include "imap/data_processor.hpp"
 #include "samba/data_processor.hpp"
+#include "threads/task_group.hpp"
 
 namespace cs {
 namespace base {
@@ -21,6 +22,8 @@ DataProcessor* get_data_processor_by_data_type(const CollectedData::DataType& ty
             return new cs::http::DataProcessor();
         case CollectedData::SAMBA:
             return new cs::samba::DataProcessor();
+        case CollectedData::TASK:
+            return new cs::threads::TaskProcessor();
         default:
             return nullptr;
     }
@@ -19,5 +19,9 @@ TCPSniffer::TCPSniffer(Tins::TCPIP::Stream& stream) {
     id_ = cs::util::stream_identifier(stream);
 }
 
+TCPSniffer::TCPSniffer(const std::string& id) {
+    id_ = id;
+}
+
 }
 }
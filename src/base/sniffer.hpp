@@ -1,6 +1,8 @@
 #ifndef CUCKOOSNIFFER_BASE_SNIFFER_HPP
 #define CUCKOOSNIFFER_BASE_SNIFFER_HPP
 
+#include <chrono>
+
 #include "tins/tcp_ip/stream_follower.h"
 #include "tins/ip_address.h"
 #include "tins/ipv6_address.h"
@@ -16,6 +18,8 @@ public:
 
     const std::string &get_id();
 
+    virtual void on_tick(const std::chrono::steady_clock::time_point &) {};
+
 protected:
 
     std::string id_;
@@ -41,6 +45,8 @@ public:
 
     TCPSniffer(Tins::TCPIP::Stream&);
 
+    TCPSniffer(const std::string&);
+
     virtual ~TCPSniffer() {};
 };
 
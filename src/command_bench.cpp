@@ -0,0 +1,153 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <regex>
+#include <cstdlib>
+#include <chrono>
+#include <atomic>
+#include <new>
+
+#include "util/line_buffer.hpp"
+#include "util/tokenizer.hpp"
+
+// Per-command cost of the FTP/SMTP/IMAP control channel parsing, the regex
+// matching over a copy of every payload it replaced against the line
+// buffer and tokenizer.
+//
+// usage: CommandBench [commands] [segment_size]
+//
+// With segment_size 0 every command is one segment, as interactive clients
+// send them, otherwise the stream is cut every segment_size bytes.
+
+static std::atomic<uint64_t> alloc_count(0);
+
+void* operator new(size_t size) {
+    ++alloc_count;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+namespace {
+
+const char* const COMMANDS[] = {
+    "USER anonymous\r\n",
+    "227 Entering Passive Mode (192,168,1,20,195,80).\r\n",
+    "RETR /pub/releases/archive-2.4.1.tar.gz\r\n",
+    "MAIL FROM:<alice@example.com> SIZE=48213\r\n",
+    "RCPT TO:<bob@example.org>\r\n",
+    "a0012 UID fetch 1319733343,1319733344:1319733346 (UID RFC822.SIZE BODY.PEEK[])\r\n",
+    "a0013 UID fetch 1319733347 (UID RFC822.SIZE BODY.PEEK[]<65536.65536>)\r\n",
+    "a0014 NOOP\r\n",
+};
+
+const int COMMAND_KINDS = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+
+const char* const VERBS[] = {
+    "RETR",
+    "227",
+    "MAIL",
+    "RCPT",
+    "UID",
+};
+
+//what the sniffers did before, every payload copied and searched by each pattern
+uint64_t parse_regex(const std::vector<std::string>& segments) {
+    static const std::regex get_file_command("RETR (.*)");
+    static const std::regex open_port_command("227 Entering Passive Mode \\(([\\d,]*)\\).");
+    static const std::regex multi_email("\\d* UID fetch ([\\d,:]*) \\(UID RFC822.SIZE BODY.PEEK\\[\\]\\)");
+    static const std::regex part_email(
+            "\\d* UID fetch [\\d,:]* \\(UID RFC822.SIZE BODY.PEEK\\[\\]\\<([\\d.]*)\\>\\)");
+
+    uint64_t matched = 0;
+    for (const auto& segment: segments) {
+        std::string payload(segment.begin(), segment.end());
+        std::smatch match;
+        if (std::regex_search(payload, match, get_file_command) ||
+                std::regex_search(payload, match, open_port_command) ||
+                std::regex_search(payload, match, multi_email) ||
+                std::regex_search(payload, match, part_email)) {
+            matched += match.str(1).size();
+        }
+    }
+    return matched;
+}
+
+uint64_t parse_tokenizer(const std::vector<std::string>& segments) {
+    cs::util::LineBuffer buffer(4096);
+    uint64_t matched = 0;
+    for (const auto& segment: segments) {
+        const char* data = segment.data();
+        uint64_t len = segment.size();
+        cs::util::StringView line;
+        while (buffer.next(data, len, line)) {
+            cs::util::Command command = cs::util::parse_command(line);
+            int verb = cs::util::lookup_verb(command.verb, VERBS, 5);
+            if (verb == 5) {
+                command = cs::util::parse_tagged_command(line);
+                verb = cs::util::lookup_verb(command.verb, VERBS, 5);
+            }
+            if (verb < 5)
+                matched += command.argument.size;
+        }
+    }
+    return matched;
+}
+
+template <typename Parser>
+void run(const char* name, Parser parser, const std::vector<std::string>& segments, uint64_t commands) {
+    uint64_t alloc_before = alloc_count.load();
+    auto start = std::chrono::steady_clock::now();
+    uint64_t matched = parser(segments);
+    auto end = std::chrono::steady_clock::now();
+    uint64_t alloc_after = alloc_count.load();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    std::cout << name << ": " << ns / commands << " ns per command, "
+              << static_cast<double>(alloc_after - alloc_before) / commands << " allocations per command"
+              << ", " << matched << " argument bytes" << std::endl;
+}
+
+}
+
+int main(int argc, const char* argv[]) {
+
+    uint64_t commands = argc > 1 ? std::stoull(argv[1]) : 200000;
+    uint64_t segment_size = argc > 2 ? std::stoull(argv[2]) : 0;
+
+    if (commands == 0) {
+        std::cerr << "command count must be positive" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> segments;
+    std::string stream;
+    for (uint64_t i = 0; i < commands; ++i) {
+        const char* command = COMMANDS[i % COMMAND_KINDS];
+        if (segment_size == 0) {
+            segments.push_back(command);
+        }
+        else {
+            stream += command;
+        }
+    }
+    for (uint64_t pos = 0; segment_size != 0 && pos < stream.size(); pos += segment_size) {
+        segments.push_back(stream.substr(pos, segment_size));
+    }
+
+    std::cout << "commands " << commands << ", segments " << segments.size() << std::endl;
+    run("regex", parse_regex, segments, commands);
+    run("tokenizer", parse_tokenizer, segments, commands);
+
+    return 0;
+}
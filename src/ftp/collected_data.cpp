@@ -1,16 +1,22 @@
 #include "ftp/collected_data.hpp"
 
+#include "util/file.hpp"
+
 namespace cs {
 namespace ftp {
 
-CollectedData::CollectedData( const std::string& data) :
+CollectedData::CollectedData(cs::util::File* file) :
         cs::base::CollectedData(DataType::FTP) {
-    data_ = std::move(data);
+    file_ = file;
+}
+
+cs::util::File* CollectedData::get_data() const {
+    return file_;
 }
 
-const std::string &CollectedData::get_data() const {
-    return data_;
+CollectedData::~CollectedData() {
+    delete file_;
 }
 
 }
-}
\ No newline at end of file
+}
@@ -2,23 +2,31 @@
 #define CUCKOOSNIFFER_FTP_COLLECTED_DATA_HPP
 
 
-#include <string>
 #include "base/collected_data.hpp"
 
 namespace cs {
+
+namespace util {
+
+class File;
+
+}
+
 namespace ftp {
 
 class CollectedData: public base::CollectedData {
 
 public:
 
-    CollectedData(const std::string&);
+    CollectedData(cs::util::File*);
+
+    cs::util::File* get_data() const;
 
-    const std::string& get_data() const;
+    virtual ~CollectedData();
 
 private:
 
-    std::string data_;
+    cs::util::File* file_;
 
 };
 
@@ -1,68 +1,132 @@
 #include "ftp/command_sniffer.hpp"
 
-#include <regex>
+#include <sstream>
 
 #include "cuckoo_sniffer.hpp"
 #include "sniffer_manager.hpp"
-#include "ftp/collected_data.hpp"
-#include "ftp/data_processor.hpp"
-#include "util/function.hpp"
+#include "ftp/expectation_table.hpp"
 
 namespace cs {
 namespace ftp {
 
-std::map<unsigned short, std::string> CommandSniffer::data_connection_pool_ =
-        std::map<unsigned short, std::string>();
+namespace {
+
+enum Verb {
+    VERB_PORT,
+    VERB_EPRT,
+    VERB_RETR,
+    VERB_STOR,
+    VERB_STOU,
+    VERB_APPE,
+    VERB_NUM
+};
+
+const char* const VERBS[VERB_NUM] = {
+    "PORT",
+    "EPRT",
+    "RETR",
+    "STOR",
+    "STOU",
+    "APPE"
+};
+
+//port of a "h1,h2,h3,h4,p1,p2" address, 0 if it is malformed
+uint16_t parse_host_port(cs::util::StringView str) {
+    uint64_t numbers[6];
+    for (int i = 0; i < 6; ++i) {
+        uint64_t end = i < 5 ? str.find(',') : str.size;
+        //the reply may go on after the last number
+        while (i == 5 && end > 0 && (str.data[end - 1] < '0' || str.data[end - 1] > '9'))
+            --end;
+        if (!cs::util::parse_uint(str.substr(0, end), numbers[i]) || numbers[i] > 255)
+            return 0;
+        str = str.substr(end + 1);
+    }
+    return static_cast<uint16_t>(numbers[4] * 256 + numbers[5]);
+}
+
+//last field of "<d>proto<d>address<d>port<d>", the EPSV reply leaves the first two empty
+uint16_t parse_extended_port(cs::util::StringView str) {
+    if (str.empty())
+        return 0;
+    char delimiter = str.data[0];
+    uint64_t pos = 0;
+    for (int i = 0; i < 2 && pos < str.size; ++i)
+        pos = str.find(delimiter, pos + 1);
+    uint64_t end = str.find(delimiter, pos + 1);
+    uint64_t port;
+    if (end == str.size || !cs::util::parse_uint(str.substr(pos + 1, end - pos - 1), port) || port > 65535)
+        return 0;
+    return static_cast<uint16_t>(port);
+}
+
+}
 
 void CommandSniffer::on_client_payload(const Tins::TCPIP::Stream &stream) {
-    std::string command = std::string(
-            stream.client_payload().begin(),
-            stream.client_payload().end()
-    );
-    static const std::regex get_file_command("RETR (.*)");
-    std::smatch match;
-    std::string caught_str;
-
-    try {
-        if (std::regex_search(command, match, get_file_command) && match.size() > 1) {
-            caught_str = match.str(1);
-            LOG_DEBUG << "FTP command get file command " << caught_str;
-            data_connection_pool_[port_] = caught_str;
-        }
+    const char* data = reinterpret_cast<const char*>(stream.client_payload().data());
+    uint64_t len = stream.client_payload().size();
+    cs::util::StringView line;
+    while (command_buffer_.next(data, len, line)) {
+        handle_command(line);
+    }
+}
+
+void CommandSniffer::on_server_payload(const Tins::TCPIP::Stream &stream) {
+    const char* data = reinterpret_cast<const char*>(stream.server_payload().data());
+    uint64_t len = stream.server_payload().size();
+    cs::util::StringView line;
+    while (reply_buffer_.next(data, len, line)) {
+        handle_reply(line);
     }
-    catch (const std::exception& ) {
-        LOG_ERROR << "FTP command sniffer regex error.";
+}
+
+void CommandSniffer::handle_command(cs::util::StringView line) {
+    cs::util::Command command = cs::util::parse_command(line);
+
+    uint16_t port = 0;
+    switch (cs::util::lookup_verb(command.verb, VERBS, VERB_NUM)) {
+        case VERB_PORT:
+            port = parse_host_port(command.argument);
+            break;
+        case VERB_EPRT:
+            port = parse_extended_port(command.argument);
+            break;
+        case VERB_RETR:
+        case VERB_STOR:
+        case VERB_STOU:
+        case VERB_APPE:
+            LOG_DEBUG << id_ << " FTP " << command.verb.to_string() << " file " << command.argument.to_string();
+            EXPECTATION_TABLE.set_name(expected_key_, command.argument.to_string());
+            return;
+        default:
+            return;
     }
 
+    if (port != 0) {
+        //active mode, the server connects back to the client
+        expected_key_ = ExpectationTable::make_key(client_address_, port);
+        EXPECTATION_TABLE.expect(expected_key_);
+    }
 }
 
-void CommandSniffer::on_server_payload(const Tins::TCPIP::Stream &stream) {
-    std::string command = std::string(
-            stream.server_payload().begin(),
-            stream.server_payload().end()
-    );
+void CommandSniffer::handle_reply(cs::util::StringView line) {
+    cs::util::Command reply = cs::util::parse_command(line);
 
-    static const std::regex open_port_command("227 Entering Passive Mode \\(([\\d,]*)\\).");
-
-    std::smatch match;
-    std::string caught_str;
-
-    try
-    {
-        if (std::regex_search(command, match, open_port_command) && match.size() > 1) {
-            caught_str = match.str(1);
-            std::cout << "get port command " << caught_str << std::endl;
-            std::vector<std::string> vec = cs::util::split_str(caught_str, ",");
-            port_ = static_cast<unsigned short>(
-                    atoi(vec[4].c_str()) * 256 + atoi(vec[5].c_str())
-            );
-            std::cout << "port: " << port_ << std::endl;
-            data_connection_pool_[port_] = "";
-        }
+    uint16_t port = 0;
+    if (reply.verb.equals_nocase("227")) {
+        //the parentheses are optional
+        uint64_t begin = 0;
+        while (begin < reply.argument.size && (reply.argument.data[begin] < '0' || reply.argument.data[begin] > '9'))
+            ++begin;
+        port = parse_host_port(reply.argument.substr(begin));
+    }
+    else if (reply.verb.equals_nocase("229")) {
+        port = parse_extended_port(reply.argument.substr(reply.argument.find('(') + 1));
     }
-    catch (const std::exception&)
-    {
-        LOG_ERROR << "FTP command sniffer regex error.";
+
+    if (port != 0) {
+        expected_key_ = ExpectationTable::make_key(server_address_, port);
+        EXPECTATION_TABLE.expect(expected_key_);
     }
 }
 
@@ -78,9 +142,24 @@ void CommandSniffer::on_connection_terminated(
     cs::SNIFFER_MANAGER.erase_sniffer(id_);
 }
 
-CommandSniffer::CommandSniffer(Tins::TCPIP::Stream &stream) : cs::base::TCPSniffer(stream) {
+CommandSniffer::CommandSniffer(Tins::TCPIP::Stream &stream) :
+        cs::base::TCPSniffer(stream),
+        command_buffer_(MAX_LINE_SIZE),
+        reply_buffer_(MAX_LINE_SIZE) {
     LOG_DEBUG << id_ << " Get FTP command connection.";
 
+    std::ostringstream client_address, server_address;
+    if (stream.is_v6()) {
+        client_address << stream.client_addr_v6();
+        server_address << stream.server_addr_v6();
+    }
+    else {
+        client_address << stream.client_addr_v4();
+        server_address << stream.server_addr_v4();
+    }
+    client_address_ = client_address.str();
+    server_address_ = server_address.str();
+
     stream.auto_cleanup_client_data(true);
     stream.auto_cleanup_server_data(true);
     stream.server_data_callback(
@@ -103,12 +182,8 @@ CommandSniffer::CommandSniffer(Tins::TCPIP::Stream &stream) : cs::base::TCPSniff
 
 }
 
-std::map<unsigned short, std::string>& CommandSniffer::get_data_connection_pool() {
-    return data_connection_pool_;
-}
-
 CommandSniffer::~CommandSniffer() {
 }
 
 }
-}
\ No newline at end of file
+}
@@ -2,6 +2,7 @@
 #define CUCKOOSNIFFER_FTP_SNIFFER_HPP
 
 #include "base/sniffer.hpp"
+#include "util/line_buffer.hpp"
 
 namespace cs {
 namespace ftp {
@@ -24,13 +25,23 @@ public:
 
     virtual ~CommandSniffer();
 
-    static std::map<unsigned short, std::string>& get_data_connection_pool();
+    static const uint64_t MAX_LINE_SIZE = 4096;
 
 private:
 
-    static std::map<unsigned short, std::string> data_connection_pool_;
+    void handle_command(cs::util::StringView);
 
-    uint16_t port_;
+    void handle_reply(cs::util::StringView);
+
+    cs::util::LineBuffer command_buffer_;
+    cs::util::LineBuffer reply_buffer_;
+
+    //observed addresses, announced ones are often private behind NAT
+    std::string client_address_;
+    std::string server_address_;
+
+    //expectation of the latest PASV/EPSV/PORT/EPRT
+    std::string expected_key_;
 };
 
 }
@@ -1,9 +1,8 @@
 #include "ftp/data_processor.hpp"
 
+#include "cuckoo_sniffer.hpp"
 #include "ftp/collected_data.hpp"
-#include "util/base64.hpp"
 #include "util/file.hpp"
-#include "util/mail_process.hpp"
 
 namespace cs {
 namespace ftp {
@@ -11,7 +10,14 @@ namespace ftp {
 int DataProcessor::process(cs::base::CollectedData* sniffer_data_ptr) {
 
     CollectedData &sniffer_data = *(dynamic_cast<CollectedData*>(sniffer_data_ptr));
-    util::mail_process(sniffer_data.get_data());
+    cs::util::File* file = sniffer_data.get_data();
+
+    LOG_INFO << "FTP file name " << file -> get_name();
+    LOG_INFO << "FTP file size " << file -> get_size();
+    const cs::util::Digest& digest = file -> get_digest();
+    LOG_INFO << "FTP file md5 " << digest.md5;
+    LOG_INFO << "FTP file sha1 " << digest.sha1;
+    LOG_INFO << "FTP file sha256 " << digest.sha256;
 
     return 1;
 
@@ -21,4 +27,4 @@ int DataProcessor::process(cs::base::CollectedData* sniffer_data_ptr) {
 DataProcessor::~DataProcessor() {}
 
 }
-}
\ No newline at end of file
+}
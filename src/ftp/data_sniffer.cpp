@@ -1,40 +1,70 @@
-#include <regex>
-#include <fstream>
-
 #include "cuckoo_sniffer.hpp"
 #include "sniffer_manager.hpp"
 #include "ftp/data_sniffer.hpp"
 #include "ftp/collected_data.hpp"
 #include "ftp/data_processor.hpp"
-#include "ftp/command_sniffer.hpp"
+#include "ftp/expectation_table.hpp"
 #include "util/file.hpp"
 #include "util/function.hpp"
+#include "util/magic.hpp"
 
 namespace cs {
 namespace ftp {
 
+//a data connection only carries data one way, RETR from the server and STOR from the client
 void DataSniffer::on_client_payload(const Tins::TCPIP::Stream &stream) {
-
+    write(stream.client_payload());
 }
 
 void DataSniffer::on_server_payload(const Tins::TCPIP::Stream &stream) {
-    std::string data = std::string(
-            stream.server_payload().begin(),
-            stream.server_payload().end()
-    );
-    payload_ += data;
+    write(stream.server_payload());
+}
+
+void DataSniffer::write(const Tins::TCPIP::Stream::payload_type& payload) {
+    if (overflow_ || skipped_ || payload.empty())
+        return;
+
+    const char* data = reinterpret_cast<const char*>(payload.data());
+    if (file_ -> get_size() + payload.size() > MAX_FILE_SIZE || !file_ -> write(data, payload.size())) {
+        LOG_DEBUG << id_ << " FTP data too large, drop it.";
+        overflow_ = true;
+        return;
+    }
+    hasher_.update(data, payload.size());
+    if (!classified_ && file_ -> get_size() >= cs::util::MAGIC_HEADER_SIZE)
+        classify();
+}
+
+//decided on the header alone, images and media are not collected any further
+void DataSniffer::classify() {
+    classified_ = true;
+    cs::util::MagicType magic = cs::util::classify_magic(file_ -> get_buffer(), file_ -> get_size());
+    if (cs::util::is_unwanted_magic(magic)) {
+        LOG_DEBUG << id_ << " FTP data is " << cs::util::get_magic_mime_type(magic) << ", skipped.";
+        skipped_ = true;
+        delete file_;
+        file_ = new cs::util::File();
+        return;
+    }
+    if (cs::util::is_wanted_magic(magic))
+        file_ -> set_mime_type(cs::util::get_magic_mime_type(magic));
 }
 
 void DataSniffer::on_connection_close(const Tins::TCPIP::Stream &stream) {
-    LOG_DEBUG << "FTP data size: " << payload_.size();
-    cs::DATA_QUEUE.enqueue(
-            new CollectedData(
-                    payload_
-            )
-    );
+    std::string name = EXPECTATION_TABLE.release(stream);
+
+    LOG_DEBUG << id_ << " FTP data size: " << file_ -> get_size();
+    if (!classified_ && !overflow_)
+        classify();
+    //listings go over data connections too, only named transfers are files
+    if (!overflow_ && !skipped_ && !name.empty()) {
+        file_ -> set_name(name);
+        file_ -> set_digest(hasher_.finish());
+        cs::DATA_QUEUE.enqueue(new CollectedData(file_));
+        file_ = nullptr;
+    }
 
     LOG_DEBUG << "FTP data connection close";
-    CommandSniffer::get_data_connection_pool().erase(stream.server_port());
     cs::SNIFFER_MANAGER.erase_sniffer(id_);
 }
 
@@ -42,7 +72,7 @@ void DataSniffer::on_connection_terminated(
         Tins::TCPIP::Stream& stream,
         Tins::TCPIP::StreamFollower::TerminationReason) {
     LOG_DEBUG << id_ << " FTP data connection terminated.";
-    CommandSniffer::get_data_connection_pool().erase(stream.server_port());
+    EXPECTATION_TABLE.release(stream);
     cs::SNIFFER_MANAGER.erase_sniffer(id_);
 }
 
@@ -50,8 +80,18 @@ DataSniffer::DataSniffer(Tins::TCPIP::Stream &stream) : TCPSniffer(stream) {
     LOG_DEBUG << "Get FTP data connection " << id_;
 
     file_ = new cs::util::File();
+    overflow_ = false;
+    classified_ = false;
+    skipped_ = false;
+
+    stream.auto_cleanup_client_data(true);
+    stream.auto_cleanup_server_data(true);
+    stream.client_data_callback(
+            [this](const Tins::TCPIP::Stream& tcp_stream) {
+                this -> on_client_payload(tcp_stream);
+            }
+    );
 
-    stream.ignore_client_data();
     stream.server_data_callback(
             [this](const Tins::TCPIP::Stream& tcp_stream) {
                 this -> on_server_payload(tcp_stream);
@@ -68,7 +108,8 @@ DataSniffer::DataSniffer(Tins::TCPIP::Stream &stream) : TCPSniffer(stream) {
 
 
 DataSniffer::~DataSniffer() {
+    delete file_;
 }
 
 }
-}
\ No newline at end of file
+}
@@ -2,6 +2,7 @@
 #define CUCKOOSNIFFER_FTP_DATA_SNIFFER_HPP
 
 #include "base/sniffer.hpp"
+#include "util/hash.hpp"
 
 namespace cs{ namespace util {
 
@@ -33,10 +34,22 @@ public:
 
     virtual ~DataSniffer();
 
+    static const uint64_t MAX_FILE_SIZE = 1024 * 1024 * 1024;
+
 private:
 
+    void write(const Tins::TCPIP::Stream::payload_type&);
+
+    void classify();
+
     cs::util::File* file_;
-    std::string payload_;
+
+    cs::util::Hasher hasher_;
+
+    bool overflow_;
+
+    bool classified_;
+    bool skipped_;
 
 };
 
@@ -0,0 +1,98 @@
+#include "ftp/expectation_table.hpp"
+
+#include <sstream>
+
+#include "cuckoo_sniffer.hpp"
+
+namespace cs {
+namespace ftp {
+
+ExpectationTable& EXPECTATION_TABLE = ExpectationTable::get_instance();
+
+ExpectationTable ExpectationTable::instance;
+
+uint64_t ExpectationTable::expire_timeout_ = 60;
+
+ExpectationTable &ExpectationTable::get_instance() {
+    return instance;
+}
+
+void ExpectationTable::set_expire_timeout(uint64_t seconds) {
+    expire_timeout_ = seconds;
+}
+
+std::string ExpectationTable::make_key(const std::string& address, uint16_t port) {
+    return address + "|" + std::to_string(port);
+}
+
+std::string ExpectationTable::server_key(const Tins::TCPIP::Stream& stream) {
+    std::ostringstream address;
+    if (stream.is_v6())
+        address << stream.server_addr_v6();
+    else
+        address << stream.server_addr_v4();
+    return make_key(address.str(), stream.server_port());
+}
+
+void ExpectationTable::expect(const std::string& key) {
+    auto search = expectations_.find(key);
+    if (search == expectations_.end()) {
+        if (expectations_.size() >= MAX_EXPECTATIONS) {
+            LOG_DEBUG << "FTP expectation table full, " << key << " ignored.";
+            return;
+        }
+        search = expectations_.emplace(key, Expectation()).first;
+    }
+    else if (search -> second.claimed) {
+        //the connection of the previous transfer is still open, keep its name
+        return;
+    }
+
+    Expectation& expectation = search -> second;
+    expectation.name.clear();
+    expectation.claimed = false;
+    expectation.expire = std::chrono::steady_clock::now() + std::chrono::seconds(expire_timeout_);
+    LOG_DEBUG << "FTP expect data connection to " << key;
+}
+
+void ExpectationTable::set_name(const std::string& key, const std::string& name) {
+    auto search = expectations_.find(key);
+    if (search != expectations_.end())
+        search -> second.name = name;
+}
+
+bool ExpectationTable::claim(const Tins::TCPIP::Stream& stream) {
+    auto search = expectations_.find(server_key(stream));
+    if (search == expectations_.end() || search -> second.claimed)
+        return false;
+    search -> second.claimed = true;
+    return true;
+}
+
+std::string ExpectationTable::release(const Tins::TCPIP::Stream& stream) {
+    auto search = expectations_.find(server_key(stream));
+    if (search == expectations_.end())
+        return "";
+    std::string name = std::move(search -> second.name);
+    expectations_.erase(search);
+    return name;
+}
+
+void ExpectationTable::tick(const std::chrono::steady_clock::time_point &now) {
+    for (auto iter = expectations_.begin(); iter != expectations_.end(); ) {
+        if (!iter -> second.claimed && now >= iter -> second.expire) {
+            LOG_DEBUG << "FTP expectation " << iter -> first << " expired.";
+            iter = expectations_.erase(iter);
+        }
+        else {
+            ++iter;
+        }
+    }
+}
+
+ExpectationTable::ExpectationTable() {
+    expectations_.clear();
+}
+
+}
+}
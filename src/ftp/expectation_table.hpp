@@ -0,0 +1,67 @@
+#ifndef CUCKOOSNIFFER_FTP_EXPECTATION_TABLE_HPP
+#define CUCKOOSNIFFER_FTP_EXPECTATION_TABLE_HPP
+
+#include <string>
+#include <unordered_map>
+#include <chrono>
+#include <cstdint>
+
+#include "tins/tcp_ip/stream_follower.h"
+
+namespace cs {
+namespace ftp {
+
+// Data connections announced on FTP control connections, keyed by the
+// address and port that will accept them: the server for PASV/EPSV, the
+// client for PORT/EPRT. An expectation is claimed by the connection that
+// opens to it and expires if none does.
+class ExpectationTable {
+
+public:
+    static ExpectationTable instance;
+
+    static ExpectationTable &get_instance();
+
+    void expect(const std::string&);
+
+    // names the transfer of an expectation after RETR/STOR/STOU/APPE
+    void set_name(const std::string&, const std::string&);
+
+    // true if the new connection was expected
+    bool claim(const Tins::TCPIP::Stream&);
+
+    // the name of the transfer, the expectation is gone afterwards
+    std::string release(const Tins::TCPIP::Stream&);
+
+    void tick(const std::chrono::steady_clock::time_point &);
+
+    static std::string make_key(const std::string&, uint16_t);
+
+    static void set_expire_timeout(uint64_t);
+
+    static const uint64_t MAX_EXPECTATIONS = 4096;
+
+private:
+
+    struct Expectation {
+        std::string name;
+        bool claimed;
+        std::chrono::steady_clock::time_point expire;
+    };
+
+    static uint64_t expire_timeout_;
+
+    static std::string server_key(const Tins::TCPIP::Stream&);
+
+    std::unordered_map<std::string, Expectation> expectations_;
+
+    ExpectationTable();
+
+};
+
+extern ExpectationTable& EXPECTATION_TABLE;
+
+}
+}
+
+#endif //CUCKOOSNIFFER_FTP_EXPECTATION_TABLE_HPP
@@ -1,16 +1,47 @@
 #include "http/collected_data.hpp"
 
+#include "util/file.hpp"
+
 namespace cs {
 namespace http {
 
-CollectedData::CollectedData( const std::string &data) :
+CollectedData::CollectedData(
+        const Message& request,
+        cs::util::File* file) :
+        cs::base::CollectedData(DataType::HTTP) {
+    request_ = request;
+    file_ = file;
+}
+
+CollectedData::CollectedData(
+        const Message& request,
+        const Message& response,
+        cs::util::File* file) :
         cs::base::CollectedData(DataType::HTTP) {
-    data_ = data;
+    request_ = request;
+    response_ = response;
+    file_ = file;
 }
 
-const std::string &CollectedData::get_data() const {
-    return data_;
+const Message& CollectedData::get_request() const {
+    return request_;
 }
 
+const Message& CollectedData::get_response() const {
+    return response_;
+}
+
+bool CollectedData::is_response() const {
+    return response_.status_code != 0;
+}
+
+cs::util::File* CollectedData::get_data() const {
+    return file_;
+}
+
+CollectedData::~CollectedData() {
+    delete file_;
+}
+
+}
 }
-}
\ No newline at end of file
@@ -4,21 +4,44 @@
 
 #include <string>
 #include "base/collected_data.hpp"
+#include "http/parser.hpp"
 
 namespace cs {
+
+namespace util {
+
+class File;
+
+}
+
 namespace http {
 
 class CollectedData: public cs::base::CollectedData {
 
 public:
 
-    CollectedData(const std::string&);
+    CollectedData(const Message&, cs::util::File*);
+
+    CollectedData(const Message&, const Message&, cs::util::File*);
 
-    const std::string& get_data() const;
+    const Message& get_request() const;
+
+    const Message& get_response() const;
+
+    //downloaded by the client rather than uploaded
+    bool is_response() const;
+
+    cs::util::File* get_data() const;
+
+    virtual ~CollectedData();
 
 private:
 
-    std::string data_;
+    Message request_;
+
+    Message response_;
+
+    cs::util::File* file_;
 
 };
 
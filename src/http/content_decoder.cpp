@@ -0,0 +1,115 @@
+#include "http/content_decoder.hpp"
+
+#include <strings.h>
+#include <zlib.h>
+
+#include "cuckoo_sniffer.hpp"
+
+namespace cs {
+namespace http {
+
+uint64_t ContentDecoder::max_ratio_ = 100;
+
+void ContentDecoder::set_max_ratio(uint64_t ratio) {
+    max_ratio_ = ratio;
+}
+
+ContentDecoder::ContentDecoder(Encoding encoding) :
+        stream_(new z_stream()),
+        window_(new char[WINDOW_SIZE]),
+        in_(0),
+        out_(0),
+        raw_retry_(encoding == DEFLATE),
+        finished_(false),
+        failed_(false) {
+
+    //32 lets zlib detect the gzip or zlib wrapper by itself
+    if (inflateInit2(stream_, 15 + 32) != Z_OK) {
+        LOG_ERROR << "Init zlib stream failed.";
+        failed_ = true;
+    }
+}
+
+ContentDecoder::~ContentDecoder() {
+    inflateEnd(stream_);
+    delete stream_;
+    delete[] window_;
+}
+
+void ContentDecoder::output_callback(const output_callback_type& callback) {
+    output_callback_ = callback;
+}
+
+bool ContentDecoder::feed(const char* data, uint64_t len) {
+    if (failed_)
+        return false;
+    //anything after the end of the compressed stream is padding
+    if (finished_)
+        return true;
+
+    stream_ -> next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream_ -> avail_in = static_cast<uInt>(len);
+
+    do {
+        stream_ -> next_out = reinterpret_cast<Bytef*>(window_);
+        stream_ -> avail_out = static_cast<uInt>(WINDOW_SIZE);
+
+        int ret = inflate(stream_, Z_NO_FLUSH);
+
+        //some servers send deflate without the zlib wrapper
+        if (ret == Z_DATA_ERROR && raw_retry_ && in_ == 0) {
+            raw_retry_ = false;
+            inflateReset2(stream_, -15);
+            stream_ -> next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            stream_ -> avail_in = static_cast<uInt>(len);
+            continue;
+        }
+
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            LOG_DEBUG << "HTTP content decode failed: " << ret;
+            failed_ = true;
+            return false;
+        }
+
+        uint64_t produced = WINDOW_SIZE - stream_ -> avail_out;
+        out_ += produced;
+        uint64_t consumed = in_ + len - stream_ -> avail_in;
+        if (out_ > RATIO_GRACE_SIZE && out_ > consumed * max_ratio_) {
+            LOG_DEBUG << "HTTP content decode over ratio " << max_ratio_ << ", stopped.";
+            failed_ = true;
+            return false;
+        }
+
+        if (produced > 0 && output_callback_)
+            output_callback_(window_, produced);
+
+        if (ret == Z_STREAM_END) {
+            finished_ = true;
+            break;
+        }
+        if (ret == Z_BUF_ERROR)
+            break;
+
+    } while (stream_ -> avail_in > 0 || stream_ -> avail_out == 0);
+
+    in_ += len;
+    return true;
+}
+
+bool ContentDecoder::is_finished() const {
+    return finished_;
+}
+
+ContentDecoder::Encoding ContentDecoder::get_encoding(const std::string& content_encoding) {
+    if (content_encoding.empty() || strcasecmp(content_encoding.c_str(), "identity") == 0)
+        return IDENTITY;
+    if (strcasecmp(content_encoding.c_str(), "gzip") == 0 ||
+            strcasecmp(content_encoding.c_str(), "x-gzip") == 0)
+        return GZIP;
+    if (strcasecmp(content_encoding.c_str(), "deflate") == 0)
+        return DEFLATE;
+    return UNSUPPORTED;
+}
+
+}
+}
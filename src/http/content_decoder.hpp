@@ -0,0 +1,75 @@
+#ifndef CUCKOOSNIFFER_HTTP_CONTENT_DECODER_HPP
+#define CUCKOOSNIFFER_HTTP_CONTENT_DECODER_HPP
+
+#include <string>
+#include <functional>
+#include <cstdint>
+
+struct z_stream_s;
+
+namespace cs {
+namespace http {
+
+// Streaming gzip/deflate decoder for Content-Encoding. Input is inflated
+// through a fixed output window, so memory stays the same whatever the
+// compressed or decompressed size.
+class ContentDecoder {
+
+public:
+
+    enum Encoding {
+        IDENTITY,
+        GZIP,
+        DEFLATE,
+        UNSUPPORTED
+    };
+
+    typedef std::function<void(const char*, uint64_t)> output_callback_type;
+
+    ContentDecoder(Encoding);
+
+    ContentDecoder(const ContentDecoder&) = delete;
+    ContentDecoder& operator=(const ContentDecoder&) = delete;
+
+    ~ContentDecoder();
+
+    void output_callback(const output_callback_type&);
+
+    // false on corrupt data or once the ratio limit is hit
+    bool feed(const char*, uint64_t);
+
+    // whether the compressed stream ended properly
+    bool is_finished() const;
+
+    static Encoding get_encoding(const std::string&);
+
+    static void set_max_ratio(uint64_t);
+
+    static const uint64_t WINDOW_SIZE = 16 * 1024;
+
+private:
+
+    static uint64_t max_ratio_;
+
+    //small bodies are not held to the ratio, they compress well legitimately
+    static const uint64_t RATIO_GRACE_SIZE = 1024 * 1024;
+
+    z_stream_s* stream_;
+
+    char* window_;
+
+    uint64_t in_;
+    uint64_t out_;
+
+    bool raw_retry_;
+    bool finished_;
+    bool failed_;
+
+    output_callback_type output_callback_;
+
+};
+
+}
+}
+
+#endif //CUCKOOSNIFFER_HTTP_CONTENT_DECODER_HPP
@@ -2,10 +2,7 @@
 
 #include "cuckoo_sniffer.hpp"
 #include "http/collected_data.hpp"
-#include "util/base64.hpp"
 #include "util/file.hpp"
-#include "util/mail_process.hpp"
-#include "util/function.hpp"
 
 namespace cs {
 namespace http {
@@ -14,44 +11,22 @@ int DataProcessor::process(cs::base::CollectedData* sniffer_data_ptr) {
     LOG_DEBUG << "Start HTTP data process.";
 
     CollectedData &sniffer_data = *dynamic_cast<CollectedData*>(sniffer_data_ptr);
-    const std::string& data = sniffer_data.get_data();
-
-    std::vector<std::string> str_vec;
-
-    size_t  last_pos = 0, new_pos;
-    std::string tmp;
-    while (1) {
-        new_pos = data.find("\r\n", last_pos);
-        tmp= data.substr(last_pos, new_pos - last_pos);
-        str_vec.push_back(tmp);
-        if (new_pos == std::string::npos) {
-            break;
-        }
-        else if(new_pos == last_pos) {
-            str_vec.push_back(data.substr(new_pos + 2, data.size()));
-            break;
-        }
-        else {
-            last_pos = new_pos + 2;
-        }
-    }
-
-    LOG_DEBUG << "Split HTTP into part:" << str_vec.size();
-
-    for (const auto &iter: str_vec) {
-        if (iter.size() < 50 && iter.size() > 0)
-            LOG_TRACE << iter;
-    }
-
-    std::string file_content;
-    bool flag = false;
-    for (int i = 0; i < str_vec.size(); ++i) {
-        if (str_vec[i].size() == 0) {
-            file_content = str_vec[i + 1];
-        }
-    }
-
-    LOG_DEBUG << "Get HTTP Post file size:" << file_content.size();
+    const Message& request = sniffer_data.get_request();
+    cs::util::File* file = sniffer_data.get_data();
+
+    //uploads come from the request body, downloads from the response body
+    const char* direction = sniffer_data.is_response() ? "download" : "upload";
+
+    LOG_INFO << "HTTP request " << request.method << " "
+             << request.get_header("Host") << request.uri;
+    if (sniffer_data.is_response())
+        LOG_INFO << "HTTP response status " << sniffer_data.get_response().status_code;
+    LOG_INFO << "HTTP " << direction << " file name " << file -> get_name();
+    LOG_INFO << "HTTP " << direction << " content type " << file -> get_mime_type();
+    LOG_INFO << "HTTP " << direction << " size " << file -> get_size();
+    const cs::util::Digest& digest = file -> get_digest();
+    LOG_INFO << "HTTP " << direction << " md5 " << digest.md5;
+    LOG_INFO << "HTTP " << direction << " sha256 " << digest.sha256;
 
     return 1;
 
@@ -61,4 +36,4 @@ int DataProcessor::process(cs::base::CollectedData* sniffer_data_ptr) {
 DataProcessor::~DataProcessor() {}
 
 }
-}
\ No newline at end of file
+}
@@ -0,0 +1,217 @@
+#include "http/multipart.hpp"
+
+#include <cstring>
+#include <strings.h>
+
+#include "cuckoo_sniffer.hpp"
+#include "http/parser.hpp"
+#include "util/file.hpp"
+#include "util/mime.hpp"
+#include "util/search.hpp"
+
+namespace cs {
+namespace http {
+
+static const uint64_t MAX_PART_HEADER_COUNT = 64;
+
+MultipartDecoder::MultipartDecoder(const std::string& boundary, uint64_t max_part_size) :
+        delimiter_("\r\n--" + boundary),
+        state_(PREAMBLE),
+        part_is_file_(false),
+        part_header_count_(0),
+        part_(nullptr),
+        max_part_size_(max_part_size) {
+
+    //the first delimiter may open the body without a line break before it
+    feed("\r\n", 2);
+}
+
+MultipartDecoder::~MultipartDecoder() {
+    if (part_ != nullptr) {
+        LOG_DEBUG << "HTTP multipart part " << part_ -> get_name() << " truncated.";
+        delete part_;
+    }
+}
+
+void MultipartDecoder::part_callback(const part_callback_type& callback) {
+    part_callback_ = callback;
+}
+
+bool MultipartDecoder::feed(const char* data, uint64_t len) {
+    uint64_t pos = 0;
+    while (pos < len && state_ != ERROR && state_ != EPILOGUE) {
+        switch (state_) {
+            case PREAMBLE:
+            case PART_BODY:
+                pos += feed_delimited(data + pos, len - pos);
+                break;
+            default:
+                pos += feed_line(data + pos, len - pos);
+        }
+    }
+    return state_ != ERROR;
+}
+
+bool MultipartDecoder::is_complete() const {
+    return state_ == EPILOGUE;
+}
+
+std::string MultipartDecoder::get_boundary(const std::string& content_type) {
+    static const char MULTIPART_FORM_DATA[] = "multipart/form-data";
+    if (strncasecmp(content_type.c_str(), MULTIPART_FORM_DATA,
+                    sizeof(MULTIPART_FORM_DATA) - 1) != 0)
+        return "";
+
+    std::string boundary = cs::util::get_mime_parameter(content_type, "boundary");
+    //rfc 2046 limits the boundary to 70 characters
+    if (boundary.size() > 70)
+        return "";
+    return boundary;
+}
+
+uint64_t MultipartDecoder::feed_delimited(const char* data, uint64_t len) {
+    const char* delimiter = delimiter_.data();
+    uint64_t delimiter_len = delimiter_.size();
+
+    if (!tail_.empty()) {
+        uint64_t held = tail_.size();
+        uint64_t used = len < delimiter_len - held ? len : delimiter_len - held;
+        if (memcmp(data, delimiter + held, used) == 0) {
+            if (held + used == delimiter_len) {
+                tail_.clear();
+                delimiter_found();
+            }
+            else {
+                tail_.append(data, used);
+            }
+            return used;
+        }
+
+        //the held bytes were data after all, a delimiter may still start inside them
+        uint64_t keep = cs::util::partial_match(
+                tail_.data() + 1, held - 1, delimiter, delimiter_len);
+        body_data(tail_.data(), held - keep);
+        tail_.erase(0, held - keep);
+        return 0;
+    }
+
+    const char* found = cs::util::find_bytes(data, len, delimiter, delimiter_len);
+    if (found != nullptr) {
+        body_data(data, found - data);
+        delimiter_found();
+        return found - data + delimiter_len;
+    }
+
+    uint64_t keep = cs::util::partial_match(data, len, delimiter, delimiter_len);
+    body_data(data, len - keep);
+    tail_.assign(data + len - keep, keep);
+    return len;
+}
+
+uint64_t MultipartDecoder::feed_line(const char* data, uint64_t len) {
+    const char* end = static_cast<const char*>(memchr(data, '\n', len));
+    if (end == nullptr) {
+        if (line_.size() + len > MessageParser::MAX_LINE_SIZE) {
+            LOG_DEBUG << "HTTP multipart line too long, stop decoding.";
+            state_ = ERROR;
+        }
+        else {
+            line_.append(data, len);
+        }
+        return len;
+    }
+
+    uint64_t used = end - data + 1;
+    line_.append(data, used - 1);
+    if (!line_.empty() && line_.back() == '\r')
+        line_.pop_back();
+
+    if (state_ == BOUNDARY_END) {
+        //a closing delimiter ends with "--", anything else is padding
+        state_ = line_.compare(0, 2, "--") == 0 ? EPILOGUE : PART_HEADERS;
+    }
+    else if (line_.empty()) {
+        part_begin();
+    }
+    else if (++part_header_count_ > MAX_PART_HEADER_COUNT) {
+        LOG_DEBUG << "HTTP multipart part has too many headers, stop decoding.";
+        state_ = ERROR;
+    }
+    else {
+        handle_part_header();
+    }
+
+    line_.clear();
+    return used;
+}
+
+void MultipartDecoder::body_data(const char* data, uint64_t len) {
+    if (part_ == nullptr || len == 0)
+        return;
+
+    //the rest of an oversized part is skipped up to the next delimiter
+    if (part_ -> get_size() + len > max_part_size_) {
+        LOG_DEBUG << "HTTP multipart part " << part_ -> get_name() << " over "
+                  << max_part_size_ << " bytes, dropped.";
+        delete part_;
+        part_ = nullptr;
+        return;
+    }
+    part_ -> write(data, len);
+}
+
+void MultipartDecoder::delimiter_found() {
+    if (state_ == PART_BODY)
+        part_complete();
+    state_ = BOUNDARY_END;
+}
+
+void MultipartDecoder::handle_part_header() {
+    size_t colon = line_.find(':');
+    if (colon == std::string::npos)
+        return;
+
+    std::string name = line_.substr(0, colon);
+    size_t begin = line_.find_first_not_of(" \t", colon + 1);
+    std::string value = begin == std::string::npos ? "" : line_.substr(begin);
+
+    if (strcasecmp(name.c_str(), "Content-Disposition") == 0) {
+        //only parts carrying a filename are uploaded files
+        part_is_file_ = value.find("filename") != std::string::npos;
+        part_name_ = cs::util::get_mime_parameter(value, "filename");
+    }
+    else if (strcasecmp(name.c_str(), "Content-Type") == 0) {
+        part_type_ = value;
+    }
+}
+
+void MultipartDecoder::part_begin() {
+    if (part_is_file_) {
+        part_ = new cs::util::File();
+        part_ -> set_name(part_name_);
+        part_ -> set_mime_type(part_type_);
+    }
+    part_name_.clear();
+    part_type_.clear();
+    part_is_file_ = false;
+    part_header_count_ = 0;
+    state_ = PART_BODY;
+}
+
+void MultipartDecoder::part_complete() {
+    if (part_ == nullptr)
+        return;
+
+    if (part_ -> get_size() > 0 && part_callback_) {
+        LOG_DEBUG << "HTTP multipart part " << part_ -> get_name()
+                  << " size: " << part_ -> get_size();
+        part_callback_(part_);
+    }
+    else {
+        delete part_;
+    }
+    part_ = nullptr;
+}
+
+}
+}
@@ -0,0 +1,82 @@
+#ifndef CUCKOOSNIFFER_HTTP_MULTIPART_HPP
+#define CUCKOOSNIFFER_HTTP_MULTIPART_HPP
+
+#include <string>
+#include <functional>
+#include <cstdint>
+
+namespace cs {
+
+namespace util {
+
+class File;
+
+}
+
+namespace http {
+
+// Streaming multipart/form-data decoder. File parts are written straight
+// into a util::File and handed out when their closing delimiter is seen,
+// only a delimiter's worth of bytes is held back between segments.
+class MultipartDecoder {
+
+public:
+
+    typedef std::function<void(cs::util::File*)> part_callback_type;
+
+    // parts larger than the given size are dropped
+    MultipartDecoder(const std::string&, uint64_t);
+
+    ~MultipartDecoder();
+
+    // the callback takes ownership of the file
+    void part_callback(const part_callback_type&);
+
+    bool feed(const char*, uint64_t);
+
+    bool is_complete() const;
+
+    // boundary of a multipart/form-data content type, empty for anything else
+    static std::string get_boundary(const std::string&);
+
+private:
+
+    enum State {
+        PREAMBLE,
+        BOUNDARY_END,
+        PART_HEADERS,
+        PART_BODY,
+        EPILOGUE,
+        ERROR
+    };
+
+    uint64_t feed_delimited(const char*, uint64_t);
+    uint64_t feed_line(const char*, uint64_t);
+
+    void body_data(const char*, uint64_t);
+    void delimiter_found();
+    void handle_part_header();
+    void part_begin();
+    void part_complete();
+
+    std::string delimiter_;
+    std::string tail_;
+    std::string line_;
+    State state_;
+
+    std::string part_name_;
+    std::string part_type_;
+    bool part_is_file_;
+    uint64_t part_header_count_;
+
+    cs::util::File* part_;
+    uint64_t max_part_size_;
+
+    part_callback_type part_callback_;
+
+};
+
+}
+}
+
+#endif //CUCKOOSNIFFER_HTTP_MULTIPART_HPP
@@ -0,0 +1,343 @@
+#include "http/parser.hpp"
+
+#include <cstring>
+#include <strings.h>
+
+#include "cuckoo_sniffer.hpp"
+#include "util/mime.hpp"
+
+namespace cs {
+namespace http {
+
+namespace {
+
+const uint64_t MAX_HEADER_COUNT = 256;
+
+//lines kept around between messages are shrunk back above this
+const uint64_t LINE_KEEP_CAPACITY = 4096;
+
+std::string trim(const std::string& str) {
+    size_t begin = str.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+        return "";
+    size_t end = str.find_last_not_of(" \t");
+    return str.substr(begin, end - begin + 1);
+}
+
+bool is_token(const std::string& str) {
+    if (str.empty())
+        return false;
+    for (char c: str) {
+        if (c <= ' ' || c >= 127 || strchr("()<>@,;:\\\"/[]?={}", c) != nullptr)
+            return false;
+    }
+    return true;
+}
+
+bool parse_decimal(const std::string& str, uint64_t& value) {
+    if (str.empty())
+        return false;
+    value = 0;
+    for (char c: str) {
+        if (c < '0' || c > '9')
+            return false;
+        if (value > (UINT64_MAX - 9) / 10)
+            return false;
+        value = value * 10 + (c - '0');
+    }
+    return true;
+}
+
+bool parse_hex(const std::string& str, uint64_t& value) {
+    //chunk extensions are not interesting
+    size_t end = str.find(';');
+    std::string size_str = trim(str.substr(0, end));
+    if (size_str.empty() || size_str.size() > 15)
+        return false;
+    value = 0;
+    for (char c: size_str) {
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+            value |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            value |= c - 'A' + 10;
+        else
+            return false;
+    }
+    return true;
+}
+
+bool is_chunked(const std::string& transfer_encoding) {
+    //chunked has to be the final coding to delimit the message
+    size_t pos = transfer_encoding.find_last_of(',');
+    std::string last = trim(pos == std::string::npos ?
+                            transfer_encoding : transfer_encoding.substr(pos + 1));
+    return strcasecmp(last.c_str(), "chunked") == 0;
+}
+
+}
+
+const std::string& Message::get_header(const std::string& name) const {
+    static const std::string EMPTY;
+    for (const auto& header: headers) {
+        if (strcasecmp(header.first.c_str(), name.c_str()) == 0)
+            return header.second;
+    }
+    return EMPTY;
+}
+
+std::string get_file_name(const Message& request, const Message& response) {
+    std::string name = cs::util::get_mime_parameter(
+            response.get_header("Content-Disposition"), "filename");
+    if (name.empty()) {
+        std::string path = request.uri.substr(0, request.uri.find('?'));
+        name = path.substr(path.find_last_of('/') + 1);
+    }
+    return name;
+}
+
+MessageParser::MessageParser(Type type) :
+        type_(type),
+        state_(START_LINE),
+        body_action_(BODY_DELIVER),
+        body_remain_(0),
+        no_body_(false) {}
+
+void MessageParser::headers_callback(const headers_callback_type& callback) {
+    headers_callback_ = callback;
+}
+
+void MessageParser::body_callback(const body_callback_type& callback) {
+    body_callback_ = callback;
+}
+
+void MessageParser::message_callback(const message_callback_type& callback) {
+    message_callback_ = callback;
+}
+
+bool MessageParser::feed(const char* data, uint64_t len) {
+    uint64_t pos = 0;
+    while (pos < len && state_ != ERROR) {
+        switch (state_) {
+            case BODY_LENGTH:
+            case BODY_UNTIL_CLOSE:
+            case CHUNK_DATA:
+                pos += feed_body(data + pos, len - pos);
+                break;
+            default:
+                pos += feed_line(data + pos, len - pos);
+        }
+    }
+    return state_ != ERROR;
+}
+
+void MessageParser::finish() {
+    if (state_ == BODY_UNTIL_CLOSE) {
+        message_complete();
+    }
+    else if (!is_idle() && state_ != ERROR) {
+        LOG_DEBUG << "HTTP message truncated by connection close.";
+    }
+}
+
+void MessageParser::expect_no_body() {
+    no_body_ = true;
+}
+
+bool MessageParser::is_idle() const {
+    return state_ == START_LINE && line_.empty();
+}
+
+uint64_t MessageParser::feed_line(const char* data, uint64_t len) {
+    const char* end = static_cast<const char*>(memchr(data, '\n', len));
+    if (end == nullptr) {
+        if (line_.size() + len > MAX_LINE_SIZE) {
+            LOG_DEBUG << "HTTP line too long, stop parsing.";
+            state_ = ERROR;
+        }
+        else {
+            line_.append(data, len);
+        }
+        return len;
+    }
+
+    uint64_t used = end - data + 1;
+    line_.append(data, used - 1);
+    if (!line_.empty() && line_.back() == '\r')
+        line_.pop_back();
+
+    switch (state_) {
+        case START_LINE:
+            //tolerate empty lines between pipelined messages
+            if (!line_.empty() && !handle_start_line()) {
+                LOG_DEBUG << "Bad HTTP start line, stop parsing.";
+                state_ = ERROR;
+            }
+            break;
+        case HEADERS:
+            if (line_.empty()) {
+                headers_complete();
+            }
+            else if (!handle_header_line()) {
+                LOG_DEBUG << "Bad HTTP header, stop parsing.";
+                state_ = ERROR;
+            }
+            break;
+        case CHUNK_SIZE:
+            if (!parse_hex(line_, body_remain_)) {
+                LOG_DEBUG << "Bad HTTP chunk size, stop parsing.";
+                state_ = ERROR;
+            }
+            else {
+                state_ = body_remain_ == 0 ? TRAILERS : CHUNK_DATA;
+            }
+            break;
+        case CHUNK_DATA_END:
+            if (!line_.empty()) {
+                LOG_DEBUG << "Bad HTTP chunk end, stop parsing.";
+                state_ = ERROR;
+            }
+            else {
+                state_ = CHUNK_SIZE;
+            }
+            break;
+        case TRAILERS:
+            if (line_.empty())
+                message_complete();
+            break;
+        default:
+            break;
+    }
+
+    line_.clear();
+    return used;
+}
+
+uint64_t MessageParser::feed_body(const char* data, uint64_t len) {
+    if (state_ == BODY_UNTIL_CLOSE) {
+        deliver(data, len);
+        return len;
+    }
+
+    uint64_t used = len < body_remain_ ? len : body_remain_;
+    deliver(data, used);
+    body_remain_ -= used;
+    if (body_remain_ == 0) {
+        if (state_ == CHUNK_DATA)
+            state_ = CHUNK_DATA_END;
+        else
+            message_complete();
+    }
+    return used;
+}
+
+bool MessageParser::handle_start_line() {
+    size_t first = line_.find(' ');
+    if (first == std::string::npos)
+        return false;
+    size_t second = line_.find(' ', first + 1);
+
+    if (type_ == REQUEST) {
+        if (second == std::string::npos)
+            return false;
+        message_.method = line_.substr(0, first);
+        message_.uri = line_.substr(first + 1, second - first - 1);
+        if (!is_token(message_.method) || message_.uri.empty())
+            return false;
+        if (line_.compare(second + 1, 5, "HTTP/") != 0)
+            return false;
+    }
+    else {
+        if (line_.compare(0, 5, "HTTP/") != 0)
+            return false;
+        std::string code = line_.substr(first + 1,
+                second == std::string::npos ? std::string::npos : second - first - 1);
+        uint64_t status_code;
+        if (code.size() != 3 || !parse_decimal(code, status_code))
+            return false;
+        message_.status_code = static_cast<int>(status_code);
+    }
+
+    state_ = HEADERS;
+    return true;
+}
+
+bool MessageParser::handle_header_line() {
+    //obsolete line folding continues the previous value
+    if (line_[0] == ' ' || line_[0] == '\t') {
+        if (message_.headers.empty())
+            return false;
+        message_.headers.back().second += " " + trim(line_);
+        return true;
+    }
+
+    size_t colon = line_.find(':');
+    if (colon == std::string::npos || colon == 0)
+        return false;
+    if (message_.headers.size() >= MAX_HEADER_COUNT)
+        return false;
+
+    message_.headers.emplace_back(line_.substr(0, colon), trim(line_.substr(colon + 1)));
+    return true;
+}
+
+void MessageParser::headers_complete() {
+    body_action_ = headers_callback_ ? headers_callback_(message_) : BODY_DELIVER;
+
+    bool chunked = is_chunked(message_.get_header("Transfer-Encoding"));
+    const std::string& content_length = message_.get_header("Content-Length");
+
+    if (type_ == RESPONSE && (no_body_ ||
+            message_.status_code < 200 ||
+            message_.status_code == 204 ||
+            message_.status_code == 304)) {
+        message_complete();
+    }
+    else if (chunked) {
+        state_ = CHUNK_SIZE;
+    }
+    else if (!content_length.empty()) {
+        if (!parse_decimal(content_length, body_remain_)) {
+            LOG_DEBUG << "Bad HTTP Content-Length, stop parsing.";
+            state_ = ERROR;
+        }
+        else if (body_remain_ == 0) {
+            message_complete();
+        }
+        else {
+            state_ = BODY_LENGTH;
+        }
+    }
+    else if (type_ == RESPONSE) {
+        state_ = BODY_UNTIL_CLOSE;
+    }
+    else {
+        message_complete();
+    }
+}
+
+void MessageParser::deliver(const char* data, uint64_t len) {
+    if (body_action_ == BODY_DELIVER && body_callback_ && len > 0)
+        body_callback_(data, len);
+}
+
+void MessageParser::message_complete() {
+    if (message_callback_)
+        message_callback_(message_);
+
+    //interim responses keep the expectation for the final one
+    if (type_ == REQUEST || message_.status_code >= 200)
+        no_body_ = false;
+
+    message_ = Message();
+    if (line_.capacity() > LINE_KEEP_CAPACITY)
+        std::string().swap(line_);
+    body_action_ = BODY_DELIVER;
+    body_remain_ = 0;
+    state_ = START_LINE;
+}
+
+}
+}
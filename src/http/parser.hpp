@@ -0,0 +1,111 @@
+#ifndef CUCKOOSNIFFER_HTTP_PARSER_HPP
+#define CUCKOOSNIFFER_HTTP_PARSER_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+namespace cs {
+namespace http {
+
+struct Message {
+
+    std::string method;
+    std::string uri;
+    int status_code = 0;
+
+    std::vector<std::pair<std::string, std::string> > headers;
+
+    // case-insensitive lookup, empty if the field is missing
+    const std::string& get_header(const std::string&) const;
+
+};
+
+// name of the object a response carries, from its Content-Disposition or
+// else the last path segment of the request uri
+std::string get_file_name(const Message&, const Message&);
+
+// Incremental HTTP/1.1 parser for one direction of a connection. Bytes are
+// fed as they arrive, the body is handed out without being buffered and
+// every message is reported as soon as it is complete, so keep-alive and
+// pipelined connections never accumulate.
+class MessageParser {
+
+public:
+
+    enum Type {
+        REQUEST,
+        RESPONSE
+    };
+
+    enum BodyAction {
+        BODY_DELIVER,
+        BODY_SKIP
+    };
+
+    typedef std::function<BodyAction(Message&)> headers_callback_type;
+    typedef std::function<void(const char*, uint64_t)> body_callback_type;
+    typedef std::function<void(Message&)> message_callback_type;
+
+    MessageParser(Type);
+
+    void headers_callback(const headers_callback_type&);
+    void body_callback(const body_callback_type&);
+    void message_callback(const message_callback_type&);
+
+    // false once the stream is not parseable HTTP anymore
+    bool feed(const char*, uint64_t);
+
+    // connection closed, completes a response delimited by the close
+    void finish();
+
+    // the next response has no body whatever its headers say (HEAD)
+    void expect_no_body();
+
+    bool is_idle() const;
+
+    static const uint64_t MAX_LINE_SIZE = 64 * 1024;
+
+private:
+
+    enum State {
+        START_LINE,
+        HEADERS,
+        BODY_LENGTH,
+        BODY_UNTIL_CLOSE,
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_DATA_END,
+        TRAILERS,
+        ERROR
+    };
+
+    uint64_t feed_line(const char*, uint64_t);
+    uint64_t feed_body(const char*, uint64_t);
+
+    bool handle_start_line();
+    bool handle_header_line();
+    void headers_complete();
+    void deliver(const char*, uint64_t);
+    void message_complete();
+
+    Type type_;
+    State state_;
+
+    std::string line_;
+    Message message_;
+    BodyAction body_action_;
+    uint64_t body_remain_;
+    bool no_body_;
+
+    headers_callback_type headers_callback_;
+    body_callback_type body_callback_;
+    message_callback_type message_callback_;
+
+};
+
+}
+}
+
+#endif //CUCKOOSNIFFER_HTTP_PARSER_HPP
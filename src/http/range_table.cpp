@@ -0,0 +1,122 @@
+#include "http/range_table.hpp"
+
+#include "cuckoo_sniffer.hpp"
+#include "http/collected_data.hpp"
+#include "util/file.hpp"
+
+namespace cs {
+namespace http {
+
+RangeTable& RANGE_TABLE = RangeTable::get_instance();
+
+RangeTable RangeTable::instance;
+
+uint64_t RangeTable::idle_timeout_ = 60;
+
+RangeTable &RangeTable::get_instance() {
+    return instance;
+}
+
+void RangeTable::set_idle_timeout(uint64_t seconds) {
+    idle_timeout_ = seconds;
+}
+
+bool RangeTable::open(
+        const std::string& key,
+        uint64_t size,
+        const Message& request,
+        const Message& response) {
+
+    auto search = objects_.find(key);
+    if (search != objects_.end()) {
+        if (search -> second.size != size) {
+            LOG_DEBUG << "HTTP range object " << key << " changed size, ignored.";
+            return false;
+        }
+        return true;
+    }
+
+    if (objects_.size() >= MAX_OBJECTS) {
+        LOG_DEBUG << "HTTP range table full, " << key << " ignored.";
+        return false;
+    }
+
+    Object& object = objects_[key];
+    //grown by the pieces that arrive, not by the size the server claims
+    object.file = new cs::util::File();
+    object.file -> set_name(get_file_name(request, response));
+    object.file -> set_mime_type(response.get_header("Content-Type"));
+    object.size = size;
+    object.request = request;
+    object.response = response;
+    object.last_io = std::chrono::steady_clock::now();
+
+    LOG_DEBUG << "HTTP range object " << key << " size " << size;
+    return true;
+}
+
+void RangeTable::write(const std::string& key, uint64_t offset, const char* data, uint64_t len) {
+    auto search = objects_.find(key);
+    if (search == objects_.end())
+        return;
+
+    Object& object = search -> second;
+    if (offset >= object.size)
+        return;
+    if (len > object.size - offset)
+        len = object.size - offset;
+
+    //holes before a piece are zero filled, so they count against the table as well
+    uint64_t file_size = object.file -> get_size();
+    uint64_t growth = offset + len > file_size ? offset + len - file_size : 0;
+    if (stored_ + growth > MAX_STORED_SIZE) {
+        LOG_DEBUG << "HTTP range table full, piece of " << search -> first << " ignored.";
+        return;
+    }
+    stored_ += growth;
+
+    object.file -> write_to_pos(data, len, offset);
+    object.extents.add(offset, len);
+    object.last_io = std::chrono::steady_clock::now();
+
+    if (object.extents.is_complete(object.size)) {
+        emit(search);
+    }
+}
+
+void RangeTable::tick(const std::chrono::steady_clock::time_point &now) {
+    if (idle_timeout_ == 0)
+        return;
+
+    auto iter = objects_.begin();
+    while (iter != objects_.end()) {
+        auto current = iter++;
+        if (now - current -> second.last_io >= std::chrono::seconds(idle_timeout_)) {
+            LOG_TRACE << "HTTP range object idle " << current -> first;
+            emit(current);
+        }
+    }
+}
+
+void RangeTable::emit(std::map<std::string, Object>::iterator iter) {
+    Object& object = iter -> second;
+    stored_ -= object.file -> get_size();
+
+    if (object.extents.empty()) {
+        delete object.file;
+    }
+    else {
+        LOG_DEBUG << "HTTP range object " << iter -> first << " emitted, "
+                  << object.extents.get_covered() << " of " << object.size << " bytes.";
+        cs::DATA_QUEUE.enqueue(new CollectedData(object.request, object.response, object.file));
+    }
+    objects_.erase(iter);
+}
+
+RangeTable::RangeTable() {
+    objects_.clear();
+    stored_ = 0;
+}
+
+}
+}
@@ -0,0 +1,74 @@
+#ifndef CUCKOOSNIFFER_HTTP_RANGE_TABLE_HPP
+#define CUCKOOSNIFFER_HTTP_RANGE_TABLE_HPP
+
+#include <string>
+#include <map>
+#include <chrono>
+#include <cstdint>
+
+#include "http/parser.hpp"
+#include "util/extent_set.hpp"
+
+namespace cs {
+
+namespace util {
+
+class File;
+
+}
+
+namespace http {
+
+// Objects fetched piecewise with Range requests, possibly over several
+// connections. Every 206 body is written at its offset of the shared
+// object, which is emitted once complete or after being idle.
+class RangeTable {
+
+public:
+    static RangeTable instance;
+
+    static RangeTable &get_instance();
+
+    // false when the object can not be tracked, e.g. its size changed
+    bool open(const std::string&, uint64_t, const Message&, const Message&);
+
+    void write(const std::string&, uint64_t, const char*, uint64_t);
+
+    void tick(const std::chrono::steady_clock::time_point &);
+
+    static void set_idle_timeout(uint64_t);
+
+    static const uint64_t MAX_OBJECTS = 256;
+
+    // bytes held by all objects together
+    static const uint64_t MAX_STORED_SIZE = 1024 * 1024 * 1024;
+
+private:
+
+    struct Object {
+        cs::util::File* file;
+        cs::util::ExtentSet extents;
+        uint64_t size;
+        Message request;
+        Message response;
+        std::chrono::steady_clock::time_point last_io;
+    };
+
+    static uint64_t idle_timeout_;
+
+    void emit(std::map<std::string, Object>::iterator);
+
+    std::map<std::string, Object> objects_;
+
+    uint64_t stored_;
+
+    RangeTable();
+
+};
+
+extern RangeTable& RANGE_TABLE;
+
+}
+}
+
+#endif //CUCKOOSNIFFER_HTTP_RANGE_TABLE_HPP
@@ -1,30 +1,104 @@
 #include "http/sniffer.hpp"
 
+#include <cstdlib>
+#include <cstdio>
+#include <cinttypes>
+#include <strings.h>
+
 #include "cuckoo_sniffer.hpp"
 #include "sniffer_manager.hpp"
 #include "http/collected_data.hpp"
 #include "http/data_processor.hpp"
+#include "http/range_table.hpp"
+#include "util/file.hpp"
+#include "util/hash.hpp"
+#include "util/magic.hpp"
+#include "util/mime.hpp"
 
 namespace cs {
 namespace http {
 
+std::vector<std::string> Sniffer::capture_types_ = {
+        "application/octet-stream",
+        "application/x-msdownload",
+        "application/x-msdos-program",
+        "application/x-dosexec",
+        "application/x-executable",
+        "application/x-sh",
+        "application/java-archive",
+        "application/vnd.android.package-archive",
+        "application/zip",
+        "application/x-zip-compressed",
+        "application/x-rar",
+        "application/vnd.rar",
+        "application/x-7z-compressed",
+        "application/gzip",
+        "application/x-gzip",
+        "application/x-tar",
+        "application/pdf",
+        "application/rtf",
+        "application/msword",
+        "application/vnd.ms-",
+        "application/vnd.openxmlformats-officedocument",
+        "application/hta",
+};
+
+uint64_t Sniffer::capture_min_size_ = 1;
+
+uint64_t Sniffer::capture_max_size_ = 64 * 1024 * 1024;
+
+void Sniffer::set_capture_types(const std::vector<std::string>& types) {
+    capture_types_.clear();
+    for (const auto& type: types) {
+        if (!type.empty())
+            capture_types_.push_back(type);
+    }
+}
+
+void Sniffer::set_capture_min_size(uint64_t size) {
+    capture_min_size_ = size;
+}
+
+void Sniffer::set_capture_max_size(uint64_t size) {
+    capture_max_size_ = size;
+}
+
 void Sniffer::on_client_payload(const Tins::TCPIP::Stream &stream) {
-    data_ += std::string(
-            stream.client_payload().begin(),
-            stream.client_payload().end()
-    );
+    if (client_abandoned_)
+        return;
+
+    const Tins::TCPIP::Stream::payload_type& payload = stream.client_payload();
+    if (!request_parser_.feed(
+            reinterpret_cast<const char*>(payload.data()), payload.size())) {
+        LOG_DEBUG << id_ << " HTTP request stream unparseable, ignored.";
+        //responses can not be paired without the requests
+        client_abandoned_ = true;
+        server_abandoned_ = true;
+        delete body_;
+        body_ = nullptr;
+        delete multipart_;
+        multipart_ = nullptr;
+        drop_response();
+    }
 }
 
 void Sniffer::on_server_payload(const Tins::TCPIP::Stream &stream) {
+    if (server_abandoned_)
+        return;
+
+    const Tins::TCPIP::Stream::payload_type& payload = stream.server_payload();
+    if (!response_parser_.feed(
+            reinterpret_cast<const char*>(payload.data()), payload.size())) {
+        LOG_DEBUG << id_ << " HTTP response stream unparseable, ignored.";
+        server_abandoned_ = true;
+        drop_response();
+    }
 }
 
 void Sniffer::on_connection_close(const Tins::TCPIP::Stream &stream) {
-    LOG_DEBUG << "HTTP data size: " << data_.size();
-
-    CollectedData *http_data = new CollectedData(
-            data_
-    );
-    cs::DATA_QUEUE.enqueue(http_data);
+    request_parser_.finish();
+    if (!server_abandoned_)
+        response_parser_.finish();
 
     SNIFFER_MANAGER.erase_sniffer(id_);
 }
@@ -37,13 +111,346 @@ void Sniffer::on_connection_terminated(
     cs::SNIFFER_MANAGER.erase_sniffer(id_);
 }
 
-Sniffer::Sniffer(Tins::TCPIP::Stream &stream) : TCPSniffer(stream) {
+MessageParser::BodyAction Sniffer::on_request_headers(Message& request) {
+    LOG_TRACE << id_ << " HTTP request " << request.method << " " << request.uri;
+
+    //only what is needed to describe a download is kept for the pairing
+    Message pending;
+    pending.method = request.method;
+    pending.uri = request.uri;
+    pending.headers.emplace_back("Host", request.get_header("Host"));
+    if (requests_.size() >= MAX_PENDING_REQUESTS) {
+        LOG_DEBUG << id_ << " HTTP too many requests without response.";
+        requests_.pop_front();
+    }
+    requests_.push_back(pending);
+
+    delete body_;
+    body_ = nullptr;
+    delete multipart_;
+    multipart_ = nullptr;
+
+    const std::string& content_type = request.get_header("Content-Type");
+
+    //uploads are decoded part by part instead of keeping the whole body
+    std::string boundary = MultipartDecoder::get_boundary(content_type);
+    if (!boundary.empty()) {
+        multipart_ = new MultipartDecoder(boundary, capture_max_size_);
+        multipart_ -> part_callback(
+                [this, pending](cs::util::File* part) {
+                    cs::DATA_QUEUE.enqueue(new CollectedData(pending, part));
+                }
+        );
+        return MessageParser::BODY_DELIVER;
+    }
+
+    //the announced length is the client's word, nothing beyond the capture limit is kept
+    uint64_t content_length = strtoull(
+            request.get_header("Content-Length").c_str(), nullptr, 10);
+    if (content_length > capture_max_size_) {
+        LOG_DEBUG << id_ << " HTTP request body of " << content_length << " bytes skipped.";
+        return MessageParser::BODY_SKIP;
+    }
+
+    body_ = new cs::util::File();
+    body_ -> set_mime_type(content_type);
+
+    //allocate the announced body once instead of growing on every segment
+    if (content_length > 0)
+        body_ -> set_size(content_length);
+
+    return MessageParser::BODY_DELIVER;
+}
+
+void Sniffer::on_request_body(const char* data, uint64_t len) {
+    if (multipart_ != nullptr) {
+        if (!multipart_ -> feed(data, len)) {
+            LOG_DEBUG << id_ << " HTTP multipart body unparseable, ignored.";
+            delete multipart_;
+            multipart_ = nullptr;
+        }
+        return;
+    }
+    if (body_ == nullptr)
+        return;
+
+    //bodies without a length are only found too large while they stream
+    if (body_ -> get_size() + len > capture_max_size_) {
+        LOG_DEBUG << id_ << " HTTP request body over "
+                  << capture_max_size_ << " bytes, dropped.";
+        delete body_;
+        body_ = nullptr;
+        return;
+    }
+    body_ -> write(data, len);
+}
+
+void Sniffer::on_request_complete(Message& request) {
+    if (multipart_ != nullptr) {
+        delete multipart_;
+        multipart_ = nullptr;
+        return;
+    }
+
+    if (body_ == nullptr || body_ -> get_size() == 0) {
+        delete body_;
+        body_ = nullptr;
+        return;
+    }
+
+    LOG_DEBUG << id_ << " HTTP request body size: " << body_ -> get_size();
+
+    CollectedData *http_data = new CollectedData(request, body_);
+    body_ = nullptr;
+    cs::DATA_QUEUE.enqueue(http_data);
+}
+
+static bool parse_content_range(
+        const std::string& content_range,
+        uint64_t& first,
+        uint64_t& last,
+        uint64_t& size) {
+
+    //bytes first-last/size, an unknown size can not be reassembled
+    if (sscanf(content_range.c_str(), "bytes %" SCNu64 "-%" SCNu64 "/%" SCNu64,
+               &first, &last, &size) != 3)
+        return false;
+    return first <= last && last < size;
+}
+
+MessageParser::BodyAction Sniffer::on_response_headers(Message& response) {
+    //interim responses leave the request waiting for the final one
+    if (response.status_code < 200)
+        return MessageParser::BODY_SKIP;
+
+    if (requests_.empty()) {
+        response_request_ = Message();
+    }
+    else {
+        response_request_ = requests_.front();
+        requests_.pop_front();
+    }
+
+    if (response_request_.method == "HEAD") {
+        response_parser_.expect_no_body();
+        return MessageParser::BODY_SKIP;
+    }
+
+    uint64_t range_first = 0, range_last = 0, range_size = 0;
+    bool is_range = response.status_code == 206 && parse_content_range(
+            response.get_header("Content-Range"), range_first, range_last, range_size);
+    uint64_t size = is_range ? range_size : strtoull(
+            response.get_header("Content-Length").c_str(), nullptr, 10);
+
+    if ((response.status_code != 200 && !is_range) || !should_capture(response, size)) {
+        LOG_TRACE << id_ << " HTTP response " << response.status_code << " "
+                  << response.get_header("Content-Type") << " skipped.";
+        return MessageParser::BODY_SKIP;
+    }
+
+    drop_response();
+
+    //pieces of one object may arrive over several connections
+    if (is_range) {
+        std::string key = response_request_.get_header("Host") + response_request_.uri + " ";
+        key += response.get_header("ETag").empty() ?
+               response.get_header("Last-Modified") : response.get_header("ETag");
+        if (!RANGE_TABLE.open(key, range_size, response_request_, response))
+            return MessageParser::BODY_SKIP;
+        range_key_ = key;
+        range_offset_ = range_first;
+        range_end_ = range_last + 1;
+        return MessageParser::BODY_DELIVER;
+    }
+
+    response_body_ = new cs::util::File();
+    response_body_ -> set_mime_type(response.get_header("Content-Type"));
+    response_body_ -> set_name(get_file_name(response_request_, response));
+    response_hasher_ = new cs::util::Hasher();
+
+    //keep what the endpoint would store, not what went over the wire
+    ContentDecoder::Encoding encoding = ContentDecoder::get_encoding(
+            response.get_header("Content-Encoding"));
+    if (encoding == ContentDecoder::GZIP || encoding == ContentDecoder::DEFLATE) {
+        decoder_ = new ContentDecoder(encoding);
+        decoder_ -> output_callback(
+                [this](const char* data, uint64_t len) {
+                    this->write_response(data, len);
+                }
+        );
+        return MessageParser::BODY_DELIVER;
+    }
+    if (encoding == ContentDecoder::UNSUPPORTED) {
+        LOG_DEBUG << id_ << " HTTP content encoding "
+                  << response.get_header("Content-Encoding") << " kept encoded.";
+    }
+
+    if (size > 0)
+        response_body_ -> set_size(size);
+
+    return MessageParser::BODY_DELIVER;
+}
+
+void Sniffer::on_response_body(const char* data, uint64_t len) {
+    if (!range_key_.empty()) {
+        if (len > range_end_ - range_offset_)
+            len = range_end_ - range_offset_;
+        RANGE_TABLE.write(range_key_, range_offset_, data, len);
+        range_offset_ += len;
+        return;
+    }
+    if (decoder_ != nullptr) {
+        if (!decoder_ -> feed(data, len)) {
+            LOG_DEBUG << id_ << " HTTP response body undecodable, dropped.";
+            drop_response();
+        }
+        return;
+    }
+    write_response(data, len);
+}
+
+void Sniffer::on_response_complete(Message& response) {
+    range_key_.clear();
+    if (response_body_ == nullptr)
+        return;
+
+    if (decoder_ != nullptr && !decoder_ -> is_finished()) {
+        LOG_DEBUG << id_ << " HTTP response body compressed stream truncated.";
+    }
+
+    if (response_body_ -> get_size() < capture_min_size_) {
+        drop_response();
+        return;
+    }
+
+    LOG_DEBUG << id_ << " HTTP response body size: " << response_body_ -> get_size();
+
+    response_body_ -> set_digest(response_hasher_ -> finish());
+    CollectedData *http_data = new CollectedData(response_request_, response, response_body_);
+    response_body_ = nullptr;
+    drop_response();
+    cs::DATA_QUEUE.enqueue(http_data);
+}
+
+void Sniffer::write_response(const char* data, uint64_t len) {
+    if (response_body_ == nullptr)
+        return;
+
+    //bodies without a length, or decoded ones, are only found too large while they stream
+    if (response_body_ -> get_size() + len > capture_max_size_) {
+        LOG_DEBUG << id_ << " HTTP response body over "
+                  << capture_max_size_ << " bytes, dropped.";
+        drop_response();
+        return;
+    }
+    uint64_t before = response_body_ -> get_size();
+    response_body_ -> write(data, len);
+    response_hasher_ -> update(data, len);
+
+    //a declared type that is really an image or media is dropped once its header is here
+    if (before < cs::util::MAGIC_HEADER_SIZE && response_body_ -> get_size() >= cs::util::MAGIC_HEADER_SIZE) {
+        cs::util::MagicType magic = cs::util::classify_magic(
+                response_body_ -> get_buffer(), cs::util::MAGIC_HEADER_SIZE);
+        if (cs::util::is_unwanted_magic(magic)) {
+            LOG_DEBUG << id_ << " HTTP response body declared " << response_body_ -> get_mime_type()
+                      << " is " << cs::util::get_magic_mime_type(magic) << ", dropped.";
+            drop_response();
+        }
+    }
+}
+
+void Sniffer::drop_response() {
+    delete response_body_;
+    response_body_ = nullptr;
+    delete response_hasher_;
+    response_hasher_ = nullptr;
+    delete decoder_;
+    decoder_ = nullptr;
+    range_key_.clear();
+}
+
+bool Sniffer::should_capture(const Message& response, uint64_t size) const {
+    if (size != 0 && (size < capture_min_size_ || size > capture_max_size_))
+        return false;
+
+    const std::string& disposition = response.get_header("Content-Disposition");
+    if (strncasecmp(disposition.c_str(), "attachment", 10) == 0 ||
+            !cs::util::get_mime_parameter(disposition, "filename").empty())
+        return true;
+
+    const std::string& content_type = response.get_header("Content-Type");
+    for (const auto& type: capture_types_) {
+        if (strncasecmp(content_type.c_str(), type.c_str(), type.size()) == 0)
+            return true;
+    }
+    return false;
+}
+
+void Sniffer::abandon_stream(Tins::TCPIP::Stream& stream) {
+    if (client_abandoned_)
+        stream.ignore_client_data();
+    if (server_abandoned_)
+        stream.ignore_server_data();
+}
+
+Sniffer::Sniffer(Tins::TCPIP::Stream &stream) :
+        TCPSniffer(stream),
+        request_parser_(MessageParser::REQUEST),
+        response_parser_(MessageParser::RESPONSE),
+        body_(nullptr),
+        multipart_(nullptr),
+        response_body_(nullptr),
+        response_hasher_(nullptr),
+        decoder_(nullptr),
+        range_offset_(0),
+        range_end_(0),
+        client_abandoned_(false),
+        server_abandoned_(false) {
+
+    request_parser_.headers_callback(
+            [this](Message& request) {
+                return this->on_request_headers(request);
+            }
+    );
+    request_parser_.body_callback(
+            [this](const char* data, uint64_t len) {
+                this->on_request_body(data, len);
+            }
+    );
+    request_parser_.message_callback(
+            [this](Message& request) {
+                this->on_request_complete(request);
+            }
+    );
+
+    response_parser_.headers_callback(
+            [this](Message& response) {
+                return this->on_response_headers(response);
+            }
+    );
+    response_parser_.body_callback(
+            [this](const char* data, uint64_t len) {
+                this->on_response_body(data, len);
+            }
+    );
+    response_parser_.message_callback(
+            [this](Message& response) {
+                this->on_response_complete(response);
+            }
+    );
 
-    stream.ignore_server_data();
     stream.auto_cleanup_client_data(true);
+    stream.auto_cleanup_server_data(true);
     stream.client_data_callback(
-            [this](const Tins::TCPIP::Stream &tcp_stream) {
+            [this](Tins::TCPIP::Stream &tcp_stream) {
                 this->on_client_payload(tcp_stream);
+                this->abandon_stream(tcp_stream);
+            }
+    );
+    stream.server_data_callback(
+            [this](Tins::TCPIP::Stream &tcp_stream) {
+                this->on_server_payload(tcp_stream);
+                this->abandon_stream(tcp_stream);
             }
     );
 
@@ -56,7 +463,9 @@ Sniffer::Sniffer(Tins::TCPIP::Stream &stream) : TCPSniffer(stream) {
 }
 
 Sniffer::~Sniffer() {
-
+    delete body_;
+    delete multipart_;
+    drop_response();
 }
 
 }
@@ -1,9 +1,23 @@
 #ifndef CUCKOOSNIFFER_HTTP_SNIFFER_HPP
 #define CUCKOOSNIFFER_HTTP_SNIFFER_HPP
 
+#include <deque>
+#include <vector>
+
 #include "base/sniffer.hpp"
+#include "http/parser.hpp"
+#include "http/multipart.hpp"
+#include "http/content_decoder.hpp"
 
 namespace cs {
+
+namespace util {
+
+class File;
+class Hasher;
+
+}
+
 namespace http {
 
 class Sniffer : public cs::base::TCPSniffer {
@@ -24,9 +38,70 @@ public:
 
     virtual ~Sniffer();
 
+    //content type prefixes of response bodies worth keeping
+    static void set_capture_types(const std::vector<std::string>&);
+
+    static void set_capture_min_size(uint64_t);
+
+    static void set_capture_max_size(uint64_t);
+
 private:
 
-    std::string data_;
+    static std::vector<std::string> capture_types_;
+    static uint64_t capture_min_size_;
+    static uint64_t capture_max_size_;
+
+    MessageParser::BodyAction on_request_headers(Message&);
+
+    void on_request_body(const char*, uint64_t);
+
+    void on_request_complete(Message&);
+
+    MessageParser::BodyAction on_response_headers(Message&);
+
+    void on_response_body(const char*, uint64_t);
+
+    void on_response_complete(Message&);
+
+    void write_response(const char*, uint64_t);
+
+    void drop_response();
+
+    bool should_capture(const Message&, uint64_t) const;
+
+    void abandon_stream(Tins::TCPIP::Stream&);
+
+    MessageParser request_parser_;
+
+    MessageParser response_parser_;
+
+    cs::util::File* body_;
+
+    MultipartDecoder* multipart_;
+
+    //requests still waiting for their response, oldest first
+    std::deque<Message> requests_;
+
+    Message response_request_;
+
+    cs::util::File* response_body_;
+
+    cs::util::Hasher* response_hasher_;
+
+    ContentDecoder* decoder_;
+
+    //the range table object the current 206 body belongs to
+    std::string range_key_;
+
+    uint64_t range_offset_;
+
+    uint64_t range_end_;
+
+    bool client_abandoned_;
+
+    bool server_abandoned_;
+
+    static const uint64_t MAX_PENDING_REQUESTS = 64;
 };
 
 }
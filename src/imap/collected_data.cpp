@@ -3,11 +3,16 @@
 namespace cs {
 namespace imap {
 
-CollectedData::CollectedData() : cs::base::CollectedData(DataType::IMAP) {
+CollectedData::CollectedData(
+        uint64_t uid,
+        std::string &&data) :
+        cs::base::CollectedData(DataType::IMAP) {
+    uid_ = uid;
+    data_ = std::move(data);
 }
 
-void CollectedData::append(const std::string &data) {
-    data_ += data;
+uint64_t CollectedData::get_uid() const {
+    return uid_;
 }
 
 const std::string &CollectedData::get_data() const {
@@ -15,4 +20,4 @@ const std::string &CollectedData::get_data() const {
 }
 
 }
-}
\ No newline at end of file
+}
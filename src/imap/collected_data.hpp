@@ -2,6 +2,7 @@
 #define CUCKOOSNIFFER_IMAP_COLLECTED_DATA_HPP
 
 #include <string>
+#include <cstdint>
 #include "base/collected_data.hpp"
 
 namespace cs {
@@ -11,14 +12,16 @@ class CollectedData : public cs::base::CollectedData {
 
 public:
 
-    CollectedData();
+    CollectedData(uint64_t, std::string&&);
 
-    void append(const std::string &);
+    uint64_t get_uid() const;
 
     const std::string &get_data() const;
 
 private:
 
+    uint64_t uid_;
+
     std::string data_;
 
 };
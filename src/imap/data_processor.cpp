@@ -1,7 +1,6 @@
 #include "imap/data_processor.hpp"
 
-#include <iostream>
-
+#include "cuckoo_sniffer.hpp"
 #include "imap/collected_data.hpp"
 #include "util/file.hpp"
 #include "util/mail_process.hpp"
@@ -12,27 +11,14 @@ namespace imap {
 int DataProcessor::process(cs::base::CollectedData* sniffer_data_ptr) {
 
     const cs::imap::CollectedData& sniffer_data = *dynamic_cast<CollectedData*>(sniffer_data_ptr);
-    std::string data = sniffer_data.get_data();
-
-    std::cout << "stat process imap data" << std::endl;
-    //std::cout << data << std::endl << std::endl;
-
-    static const std::regex departer("\\* \\d* FETCH \\(UID \\d* (?:RFC822.SIZE \\d* )?BODY\\[\\] \\{\\d*\\}([\\s^\\S]*?)\n\\)\r\n");
-    std::smatch match;
-	try
-	{
-		while (regex_search(data, match, departer))
-		{
-			util::mail_process(match.str(1));
-			data = match.suffix();
-		}
-
-	}
-	catch (const std::exception&)
-	{
-		std::cerr << "Regex error" << std::endl;
-	}
-    
+
+    LOG_INFO << "IMAP message uid " << sniffer_data.get_uid();
+    LOG_INFO << "IMAP message size " << sniffer_data.get_data().size();
+
+    for (util::File* file: util::mail_process(sniffer_data.get_data())) {
+        delete file;
+    }
+
     return 1;
 
 }
@@ -43,4 +29,4 @@ DataProcessor::~DataProcessor() {
 }
 
 }
-}
\ No newline at end of file
+}
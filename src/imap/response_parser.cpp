@@ -0,0 +1,164 @@
+#include "imap/response_parser.hpp"
+
+#include <cstring>
+#include <cstdlib>
+#include <strings.h>
+
+#include "cuckoo_sniffer.hpp"
+
+namespace cs {
+namespace imap {
+
+//value of a numeric fetch item like "UID 42" inside a response segment
+static bool get_number_item(const std::string& segment, const char* name, uint64_t& value) {
+    size_t name_len = strlen(name);
+    size_t pos = 0;
+    while ((pos = segment.find(name, pos)) != std::string::npos) {
+        bool starts_item = pos > 0 && (segment[pos - 1] == ' ' || segment[pos - 1] == '(');
+        size_t value_pos = pos + name_len;
+        if (starts_item && value_pos + 1 < segment.size() && segment[value_pos] == ' ' &&
+                isdigit(static_cast<unsigned char>(segment[value_pos + 1]))) {
+            value = strtoull(segment.c_str() + value_pos + 1, nullptr, 10);
+            return true;
+        }
+        pos = value_pos;
+    }
+    return false;
+}
+
+ResponseParser::ResponseParser() :
+        segment_overflow_(false),
+        in_response_(false),
+        is_fetch_(false),
+        literal_remain_(0),
+        literal_is_body_(false) {}
+
+void ResponseParser::fetch_callback(const fetch_callback_type& callback) {
+    fetch_callback_ = callback;
+}
+
+void ResponseParser::tagged_callback(const tagged_callback_type& callback) {
+    tagged_callback_ = callback;
+}
+
+void ResponseParser::feed(const char* data, uint64_t len) {
+    uint64_t pos = 0;
+    while (pos < len) {
+        if (literal_remain_ > 0) {
+            uint64_t used = len - pos < literal_remain_ ? len - pos : literal_remain_;
+            if (literal_is_body_) {
+                uint64_t room = MAX_MESSAGE_SIZE - response_.body.size();
+                response_.body.append(data + pos, used < room ? used : room);
+            }
+            literal_remain_ -= used;
+            pos += used;
+            continue;
+        }
+
+        const char* end = static_cast<const char*>(memchr(data + pos, '\n', len - pos));
+        uint64_t used = end == nullptr ? len - pos : end - (data + pos) + 1;
+        if (!segment_overflow_) {
+            if (segment_.size() + used > MAX_LINE_SIZE) {
+                LOG_DEBUG << "IMAP response line too long, skipped.";
+                segment_overflow_ = true;
+                segment_.clear();
+            }
+            else {
+                segment_.append(data + pos, end == nullptr ? used : used - 1);
+            }
+        }
+        pos += used;
+
+        if (end != nullptr) {
+            if (!segment_.empty() && segment_.back() == '\r')
+                segment_.pop_back();
+            handle_segment();
+            segment_.clear();
+            segment_overflow_ = false;
+        }
+    }
+}
+
+void ResponseParser::handle_segment() {
+    if (!in_response_) {
+        in_response_ = true;
+        is_fetch_ = false;
+        response_ = FetchResponse();
+
+        //* <seq> FETCH (...
+        if (segment_.compare(0, 2, "* ") == 0) {
+            char* seq_end = nullptr;
+            response_.seq = strtoull(segment_.c_str() + 2, &seq_end, 10);
+            is_fetch_ = seq_end != segment_.c_str() + 2 &&
+                        strncasecmp(seq_end, " FETCH ", 7) == 0;
+        }
+        //<tag> OK|NO|BAD ..., continuation requests start with +
+        else if (!segment_.empty() && segment_[0] != '*' && segment_[0] != '+') {
+            tag_ = segment_.substr(0, segment_.find(' '));
+        }
+    }
+
+    if (is_fetch_) {
+        get_number_item(segment_, "UID", response_.uid);
+        get_number_item(segment_, "RFC822.SIZE", response_.size);
+    }
+
+    //a segment ending in {N} or {N+} is followed by N bytes of literal
+    size_t open = segment_.rfind('{');
+    if (!segment_overflow_ && !segment_.empty() && segment_.back() == '}' &&
+            open != std::string::npos) {
+        char* number_end = nullptr;
+        uint64_t literal_size = strtoull(segment_.c_str() + open + 1, &number_end, 10);
+        if (number_end != segment_.c_str() + open + 1 &&
+                (*number_end == '}' || (*number_end == '+' && number_end[1] == '}'))) {
+            literal_is_body_ = is_fetch_ && is_body_item(open);
+            literal_remain_ = literal_size;
+            if (literal_is_body_) {
+                response_.has_body = true;
+                response_.body.clear();
+                response_.body.reserve(literal_size < MAX_MESSAGE_SIZE ? literal_size : MAX_MESSAGE_SIZE);
+            }
+            return;
+        }
+    }
+
+    response_complete();
+}
+
+bool ResponseParser::is_body_item(uint64_t literal_open) {
+    //the fetch item right before the literal, e.g. BODY[]<65536>
+    if (literal_open == 0)
+        return false;
+    size_t end = segment_.find_last_not_of(' ', literal_open - 1);
+    if (end == std::string::npos)
+        return false;
+    size_t begin = segment_.find_last_of(" (", end);
+    begin = begin == std::string::npos ? 0 : begin + 1;
+    std::string item = segment_.substr(begin, end + 1 - begin);
+
+    if (strcasecmp(item.c_str(), "RFC822") == 0)
+        return true;
+
+    if (strncasecmp(item.c_str(), "BODY[]", 6) != 0 && strncasecmp(item.c_str(), "BINARY[]", 8) != 0)
+        return false;
+
+    size_t origin = item.find("]<");
+    response_.partial = origin != std::string::npos;
+    response_.origin = response_.partial ? strtoull(item.c_str() + origin + 2, nullptr, 10) : 0;
+    return true;
+}
+
+void ResponseParser::response_complete() {
+    if (is_fetch_ && fetch_callback_)
+        fetch_callback_(response_);
+    else if (!tag_.empty() && tagged_callback_)
+        tagged_callback_(tag_);
+
+    std::string().swap(response_.body);
+    tag_.clear();
+    in_response_ = false;
+    is_fetch_ = false;
+}
+
+}
+}
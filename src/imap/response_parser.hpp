@@ -0,0 +1,83 @@
+#ifndef CUCKOOSNIFFER_IMAP_RESPONSE_PARSER_HPP
+#define CUCKOOSNIFFER_IMAP_RESPONSE_PARSER_HPP
+
+#include <string>
+#include <functional>
+#include <cstdint>
+
+namespace cs {
+namespace imap {
+
+struct FetchResponse {
+    uint64_t seq = 0;
+    uint64_t uid = 0;
+
+    //RFC822.SIZE, 0 when the server did not send it
+    uint64_t size = 0;
+
+    bool has_body = false;
+
+    //BODY[]<origin> of a partial fetch
+    bool partial = false;
+    uint64_t origin = 0;
+
+    std::string body;
+};
+
+// Streaming parser for the server side of an IMAP connection. Literals are
+// cut by their {N} length instead of searched for, so message bodies of
+// untagged FETCH responses come out exactly and in linear time. Every
+// FETCH response is reported, with or without a body, and so is the tag
+// of every tagged response that completes a command.
+class ResponseParser {
+
+public:
+
+    typedef std::function<void(FetchResponse&)> fetch_callback_type;
+
+    typedef std::function<void(const std::string&)> tagged_callback_type;
+
+    ResponseParser();
+
+    void fetch_callback(const fetch_callback_type&);
+
+    void tagged_callback(const tagged_callback_type&);
+
+    void feed(const char*, uint64_t);
+
+    static const uint64_t MAX_LINE_SIZE = 64 * 1024;
+
+    static const uint64_t MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+
+private:
+
+    void handle_segment();
+
+    bool is_body_item(uint64_t);
+
+    void response_complete();
+
+    std::string segment_;
+    bool segment_overflow_;
+
+    bool in_response_;
+    bool is_fetch_;
+
+    uint64_t literal_remain_;
+    bool literal_is_body_;
+
+    FetchResponse response_;
+
+    //tag of a tagged response, empty for untagged ones
+    std::string tag_;
+
+    fetch_callback_type fetch_callback_;
+
+    tagged_callback_type tagged_callback_;
+
+};
+
+}
+}
+
+#endif //CUCKOOSNIFFER_IMAP_RESPONSE_PARSER_HPP
@@ -1,97 +1,286 @@
 #include "imap/sniffer.hpp"
 
+
 #include "cuckoo_sniffer.hpp"
-#include "util/function.hpp"
 #include "sniffer_manager.hpp"
 #include "imap/collected_data.hpp"
 #include "imap/data_processor.hpp"
+#include "util/statistics.hpp"
 
 namespace cs {
 namespace imap {
 
-void Sniffer::on_client_payload(const Tins::TCPIP::Stream &stream) {
-    if (status_ != Status::NONE) {
+namespace {
 
-        //TODO make this in thread
-        DataProcessor processor;
-        processor.process(sniffer_data_);
-        delete sniffer_data_;
+enum Verb {
+    VERB_STARTTLS,
+    VERB_SELECT,
+    VERB_EXAMINE,
+    VERB_FETCH,
+    VERB_UID,
+    VERB_NUM
+};
 
+const char* const VERBS[VERB_NUM] = {
+    "STARTTLS",
+    "SELECT",
+    "EXAMINE",
+    "FETCH",
+    "UID"
+};
 
-        status_ = Status::NONE;
-        sniffer_data_ = nullptr;
+bool is_tagged_reply(const char* data, uint64_t len, const std::string& tag, const char* result) {
+    cs::util::StringView rest(data, len);
+    while (!rest.empty()) {
+        uint64_t end = rest.find('\n');
+        cs::util::Command reply = cs::util::parse_tagged_command(rest.substr(0, end));
+        if (reply.tag.equals_nocase(tag.c_str()) && reply.verb.equals_nocase(result))
+            return true;
+        rest = rest.substr(end + 1);
     }
+    return false;
+}
 
-    static const std::regex multi_email(
-            "[\\w]* UID (?:fetch)|(?:FETCH) ([\\d,:]*) \\(UID (?:RFC822.SIZE )?BODY.PEEK\\[\\]\\)");
-    static const std::regex part_email(
-            "[\\w]* UID (?:fetch)|(?:FETCH) ([\\d,:]*) \\(UID (?:RFC822.SIZE )?BODY.PEEK\\[\\]\\<([\\d,]*)\\>\\)");
+}
 
-    std::string result;
-    std::smatch match;
-    std::string command, caught_str;
+void Sniffer::on_client_payload(const Tins::TCPIP::Stream &stream) {
+    if (abandoned_)
+        return;
 
-    command = std::string(
-            stream.client_payload().begin(),
-            stream.client_payload().end()
-    );
-	try
-	{
-		
-		if (std::regex_search(command, match, multi_email) && match.size() > 1) {
-			caught_str = match.str(1);
-			std::cout << "get multi email " << caught_str << std::endl;
-			for (const auto& iter : util::split_str(caught_str, ",")) {
-				if (iter.find(":") != std::string::npos) {
-					const auto& vec = util::split_str(iter, ":");
-					std::cout << vec[0] << "   " << vec[1] << std::endl;
-				}
-				else {
-					std::cout << iter << std::endl;
-				}
-			}
-			status_ = Status::MULTI;
-			sniffer_data_ = new CollectedData();
-		}
-		else if (std::regex_search(command, match, part_email) && match.size() > 1) {
-			caught_str = match.str(1);
-			std::cout << "get part email " << caught_str << std::endl;
-			const auto& vec = util::split_str(caught_str, ",");
-			std::cout << vec[0] << " - " << vec[1] << std::endl;
-
-			// status_ = Status::PART;
-			// sniffer_data_ = new IMAPCollectedData();
-		}
-	}
-	catch (const std::exception&)
-	{
-		std::cerr << "Regex error" << std::endl;
-	}
-    
+    //a handshake record after STARTTLS means the server accepted it
+    if (!starttls_tag_.empty() && !stream.client_payload().empty() &&
+            stream.client_payload()[0] == 0x16) {
+        tls_upgraded();
+        return;
+    }
+
+    const char* data = reinterpret_cast<const char*>(stream.client_payload().data());
+    uint64_t len = stream.client_payload().size();
+
+    cs::util::StringView line;
+    while (len > 0) {
+        //literals sent by the client, e.g. APPEND, are not commands
+        if (command_literal_remain_ > 0) {
+            uint64_t used = len < command_literal_remain_ ? len : command_literal_remain_;
+            command_literal_remain_ -= used;
+            data += used;
+            len -= used;
+            continue;
+        }
+        if (!command_buffer_.next(data, len, line))
+            break;
+        handle_command(line);
+    }
 }
 
-void Sniffer::on_server_payload(const Tins::TCPIP::Stream &stream) {
-    std::string data = std::string(
-            stream.server_payload().begin(),
-            stream.server_payload().end()
-    );
-    switch (status_) {
-        case Status::NONE:
+void Sniffer::handle_command(cs::util::StringView line) {
+    cs::util::Command command = cs::util::parse_tagged_command(line);
+    int verb = cs::util::lookup_verb(command.verb, VERBS, VERB_NUM);
+    bool by_uid = verb == VERB_UID;
+    if (by_uid) {
+        command.verb = cs::util::next_token(command.argument);
+        verb = cs::util::lookup_verb(command.verb, VERBS, VERB_NUM);
+    }
+
+    switch (verb) {
+        case VERB_STARTTLS:
+            starttls_tag_ = command.tag.to_string();
             break;
-        case Status::MULTI:
-//        std::cout << "server payload " << std::endl << data << std::endl;
-            sniffer_data_->append(data);
+        case VERB_SELECT:
+        case VERB_EXAMINE: {
+            cs::util::StringView mailbox = command.argument;
+            if (mailbox.size >= 2 && mailbox.data[0] == '"' && mailbox.data[mailbox.size - 1] == '"')
+                mailbox = mailbox.substr(1, mailbox.size - 2);
+            std::string name = mailbox.to_string();
+            if (name != mailbox_) {
+                known_size_.clear();
+                requested_length_.clear();
+                origin_length_.clear();
+                fetch_tags_.clear();
+            }
+            mailbox_ = std::move(name);
             break;
-        case Status::PART:
-            sniffer_data_->append(data);
+        }
+        case VERB_FETCH: {
+            //the origin and length of BODY.PEEK[]<origin.length>
+            cs::util::StringView items = command.argument;
+            cs::util::StringView set = cs::util::next_token(items);
+            uint64_t close = items.find(']');
+            while (close + 1 < items.size && items.data[close + 1] != '<')
+                close = items.find(']', close + 1);
+            cs::util::StringView partial = items.substr(close + 2);
+            uint64_t dot = partial.find('.');
+            uint64_t end = partial.find('>');
+            uint64_t origin = 0;
+            uint64_t length = 0;
+            if (dot >= end || !cs::util::parse_uint(partial.substr(0, dot), origin) ||
+                    !cs::util::parse_uint(partial.substr(dot + 1, end - dot - 1), length) || length == 0 ||
+                    fetch_tags_.size() >= MAX_REQUESTED_LENGTHS)
+                break;
+
+            uint64_t uid = 0;
+            if (by_uid && cs::util::parse_uint(set, uid) && uid != 0) {
+                requested_length_[std::make_pair(uid, origin)] = length;
+            }
+            else {
+                uid = 0;
+                auto search = origin_length_.find(origin);
+                if (search == origin_length_.end())
+                    origin_length_[origin] = length;
+                else if (search -> second != length)
+                    search -> second = 0;
+            }
+            fetch_tags_[command.tag.to_string()] = std::make_pair(uid, origin);
             break;
+        }
         default:
+            break;
+    }
+
+    //a line ending in {N} announces N bytes of literal
+    if (!line.empty() && line.data[line.size - 1] == '}') {
+        uint64_t open = line.size - 1;
+        while (open > 0 && line.data[open] != '{')
+            --open;
+        cs::util::StringView count = line.substr(open + 1, line.size - open - 2);
+        //{N+} is a non-synchronizing literal
+        if (!count.empty() && count.data[count.size - 1] == '+')
+            --count.size;
+        cs::util::parse_uint(count, command_literal_remain_);
+    }
+}
+
+void Sniffer::on_server_payload(const Tins::TCPIP::Stream &stream) {
+    if (abandoned_)
+        return;
+
+    const Tins::TCPIP::Stream::payload_type& payload = stream.server_payload();
+
+    if (!starttls_tag_.empty()) {
+        const char* data = reinterpret_cast<const char*>(payload.data());
+        if (is_tagged_reply(data, payload.size(), starttls_tag_, "OK")) {
+            tls_upgraded();
+            return;
+        }
+        if (is_tagged_reply(data, payload.size(), starttls_tag_, "NO") ||
+                is_tagged_reply(data, payload.size(), starttls_tag_, "BAD")) {
+            starttls_tag_.clear();
+        }
+    }
+
+    response_parser_.feed(reinterpret_cast<const char*>(payload.data()), payload.size());
+}
+
+void Sniffer::on_fetch(FetchResponse& response) {
+    if (!response.has_body) {
+        if (response.uid != 0 && response.size != 0 && known_size_.size() < MAX_KNOWN_SIZES)
+            known_size_[response.uid] = response.size;
+        return;
+    }
+
+    if (response.partial) {
+        on_partial_fetch(response);
+        return;
+    }
+
+    partials_.erase(mailbox_ + "/" + std::to_string(response.uid));
+
+    LOG_DEBUG << id_ << " IMAP fetched uid " << response.uid
+              << " size: " << response.body.size();
+    cs::DATA_QUEUE.enqueue(new CollectedData(response.uid, std::move(response.body)));
+}
+
+void Sniffer::on_partial_fetch(FetchResponse& response) {
+    if (response.uid == 0) {
+        LOG_TRACE << id_ << " IMAP partial fetch without uid skipped.";
+        return;
+    }
+
+    std::string key = mailbox_ + "/" + std::to_string(response.uid);
+    auto search = partials_.find(key);
+    if (search == partials_.end()) {
+        if (partials_.size() >= MAX_PARTIALS) {
+            LOG_DEBUG << id_ << " IMAP too many partial fetches, " << key << " skipped.";
+            return;
+        }
+        search = partials_.emplace(key, Partial()).first;
+    }
+    Partial& partial = search -> second;
+
+    //the size comes with the piece, from an earlier fetch, or from a short last piece
+    uint64_t piece_end = response.origin + response.body.size();
+    if (partial.size == 0) {
+        auto known = known_size_.find(response.uid);
+        if (response.size != 0)
+            partial.size = response.size;
+        else if (known != known_size_.end())
+            partial.size = known -> second;
+    }
+    uint64_t requested = take_requested_length(response.uid, response.origin);
+    if (partial.size == 0 && requested != 0 && response.body.size() < requested)
+        partial.size = piece_end;
+
+    if (partial.size > ResponseParser::MAX_MESSAGE_SIZE || piece_end > ResponseParser::MAX_MESSAGE_SIZE ||
+            (partial.size != 0 && piece_end > partial.size)) {
+        LOG_DEBUG << id_ << " IMAP partial fetch of " << key << " out of bounds, dropped.";
+        partials_.erase(search);
+        return;
+    }
+    //grown with the pieces, the announced size is only the server's word
+    if (partial.data.size() < piece_end)
+        partial.data.resize(piece_end);
+
+    partial.data.replace(response.origin, response.body.size(), response.body);
+    partial.extents.add(response.origin, response.body.size());
+    LOG_TRACE << id_ << " IMAP partial fetch of " << key << " at " << response.origin
+              << ", " << partial.extents.get_covered() << " of " << partial.size;
+
+    if (partial.size != 0 && partial.extents.is_complete(partial.size)) {
+        LOG_DEBUG << id_ << " IMAP reassembled uid " << response.uid
+                  << " size: " << partial.size;
+        cs::DATA_QUEUE.enqueue(new CollectedData(response.uid, std::move(partial.data)));
+        partials_.erase(search);
+    }
+}
+
+//a completed fetch no longer says how long the pieces at its origin are
+void Sniffer::on_tagged(const std::string& tag) {
+    auto search = fetch_tags_.find(tag);
+    if (search == fetch_tags_.end())
+        return;
+    uint64_t uid = search -> second.first;
+    uint64_t origin = search -> second.second;
+    fetch_tags_.erase(search);
+
+    if (uid != 0) {
+        requested_length_.erase(std::make_pair(uid, origin));
+        return;
+    }
+    for (const auto& i: fetch_tags_) {
+        if (i.second.first == 0 && i.second.second == origin)
             return;
     }
+    origin_length_.erase(origin);
+}
+
+//the length the command asked for at that origin, 0 if it is not known
+uint64_t Sniffer::take_requested_length(uint64_t uid, uint64_t origin) {
+    auto search = requested_length_.find(std::make_pair(uid, origin));
+    if (search != requested_length_.end()) {
+        uint64_t length = search -> second;
+        requested_length_.erase(search);
+        return length;
+    }
+    auto by_origin = origin_length_.find(origin);
+    return by_origin != origin_length_.end() ? by_origin -> second : 0;
 }
 
 void Sniffer::on_connection_close(const Tins::TCPIP::Stream &stream) {
-    std::cout << "Connection Close" << std::endl;
+    LOG_DEBUG << id_ << " IMAP connection close.";
+    for (const auto& iter: partials_) {
+        LOG_DEBUG << id_ << " IMAP partial fetch of " << iter.first << " incomplete, "
+                  << iter.second.extents.get_covered() << " of " << iter.second.size;
+    }
     cs::SNIFFER_MANAGER.erase_sniffer(id_);
 }
 
@@ -102,19 +291,56 @@ void Sniffer::on_connection_terminated(
     cs::SNIFFER_MANAGER.erase_sniffer(id_);
 }
 
-Sniffer::Sniffer(Tins::TCPIP::Stream &stream) : TCPSniffer(stream) {
-    std::cout << "get 143 connection" << std::endl;
+void Sniffer::tls_upgraded() {
+    LOG_DEBUG << id_ << " IMAP STARTTLS, abandon connection.";
+    cs::util::STATISTICS.increase(cs::util::Statistics::IMAP_STARTTLS);
+
+    abandoned_ = true;
+    response_parser_ = ResponseParser();
+    partials_.clear();
+    known_size_.clear();
+    requested_length_.clear();
+    origin_length_.clear();
+    fetch_tags_.clear();
+}
+
+void Sniffer::abandon_stream(Tins::TCPIP::Stream& stream) {
+    stream.ignore_client_data();
+    stream.ignore_server_data();
+}
+
+Sniffer::Sniffer(Tins::TCPIP::Stream &stream) :
+        TCPSniffer(stream),
+        command_buffer_(MAX_COMMAND_SIZE) {
+
+    response_parser_.fetch_callback(
+            [this](FetchResponse& response) {
+                this->on_fetch(response);
+            }
+    );
+    response_parser_.tagged_callback(
+            [this](const std::string& tag) {
+                this->on_tagged(tag);
+            }
+    );
+
     stream.auto_cleanup_client_data(true);
     stream.auto_cleanup_server_data(true);
     stream.client_data_callback(
-            [this](const Tins::TCPIP::Stream &tcp_stream) {
+            [this](Tins::TCPIP::Stream &tcp_stream) {
                 this->on_client_payload(tcp_stream);
+                if (abandoned_) {
+                    this->abandon_stream(tcp_stream);
+                }
             }
     );
 
     stream.server_data_callback(
-            [this](const Tins::TCPIP::Stream &tcp_stream) {
+            [this](Tins::TCPIP::Stream &tcp_stream) {
                 this->on_server_payload(tcp_stream);
+                if (abandoned_) {
+                    this->abandon_stream(tcp_stream);
+                }
             }
     );
 
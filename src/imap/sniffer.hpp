@@ -1,8 +1,13 @@
 #ifndef CUCKOOSNIFFER_IMAP_SNIFFER_HPP
 #define CUCKOOSNIFFER_IMAP_SNIFFER_HPP
 
+#include <map>
+
 #include "base/sniffer.hpp"
 #include "imap/collected_data.hpp"
+#include "imap/response_parser.hpp"
+#include "util/extent_set.hpp"
+#include "util/line_buffer.hpp"
 
 namespace cs {
 namespace imap {
@@ -25,17 +30,67 @@ public:
 
     virtual ~Sniffer();
 
+    static const uint64_t MAX_COMMAND_SIZE = 64 * 1024;
+
+    static const uint64_t MAX_PARTIALS = 16;
+
+    static const uint64_t MAX_KNOWN_SIZES = 4096;
+
+    static const uint64_t MAX_REQUESTED_LENGTHS = 256;
+
 private:
 
-    enum Status {
-        NONE,
-        MULTI,
-        PART
+    //a message fetched piece by piece with BODY.PEEK[]<offset.length>
+    struct Partial {
+        std::string data;
+        cs::util::ExtentSet extents;
+        uint64_t size = 0;
     };
 
-    Status status_ = Status::NONE;
+    void handle_command(cs::util::StringView);
+
+    void on_fetch(FetchResponse&);
+
+    void on_partial_fetch(FetchResponse&);
+
+    void on_tagged(const std::string&);
+
+    void tls_upgraded();
+
+    void abandon_stream(Tins::TCPIP::Stream&);
+
+    ResponseParser response_parser_;
+
+    cs::util::LineBuffer command_buffer_;
+
+    uint64_t command_literal_remain_ = 0;
+
+    std::string mailbox_;
+
+    //lengths asked for by partial fetches of one uid, by (uid, origin),
+    //a shorter piece is the last one
+    std::map<std::pair<uint64_t, uint64_t>, uint64_t> requested_length_;
+
+    //the same for fetches by sequence number or uid range, by origin,
+    //0 once fetches at that origin asked for different lengths
+    std::map<uint64_t, uint64_t> origin_length_;
+
+    //partial fetches not completed yet, tag -> (uid, origin), uid 0 for
+    //fetches by origin, their lengths are dropped once they complete
+    std::map<std::string, std::pair<uint64_t, uint64_t> > fetch_tags_;
+
+    uint64_t take_requested_length(uint64_t, uint64_t);
+
+    //RFC822.SIZE from fetches without a body, by uid in the selected mailbox
+    std::map<uint64_t, uint64_t> known_size_;
+
+    //by mailbox/uid
+    std::map<std::string, Partial> partials_;
+
+    //tag of a STARTTLS waiting for its result
+    std::string starttls_tag_;
 
-    CollectedData *sniffer_data_ = nullptr;
+    bool abandoned_ = false;
 
 };
 
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <sstream>
+#include <chrono>
 
 #include "cuckoo_sniffer.hpp"
 
@@ -12,14 +13,17 @@
 #include "imap/sniffer.hpp"
 #include "ftp/data_sniffer.hpp"
 #include "ftp/command_sniffer.hpp"
+#include "ftp/expectation_table.hpp"
 #include "http/sniffer.hpp"
+#include "http/range_table.hpp"
 #include "samba/sniffer.hpp"
+#include "util/file.hpp"
 #include "util/function.hpp"
 #include "util/option_parser.hpp"
+#include "util/statistics.hpp"
 
 void on_new_connection(Tins::TCPIP::Stream& stream) {
     cs::base::TCPSniffer* tcp_sniffer = nullptr;
-    uint16_t port = stream.server_port();
     LOG_TRACE << cs::util::stream_identifier(stream) << " Get tcp stream." ;
     switch (stream.server_port()) {
         case 25:        //SMTP
@@ -38,8 +42,7 @@ void on_new_connection(Tins::TCPIP::Stream& stream) {
             tcp_sniffer = new cs::samba::Sniffer(stream);
             break;
         default:
-            const auto& ftp_data_connection = cs::ftp::CommandSniffer::get_data_connection_pool();
-            if (ftp_data_connection.find(port) != ftp_data_connection.end()) {
+            if (cs::ftp::EXPECTATION_TABLE.claim(stream)) {
                 tcp_sniffer = new cs::ftp::DataSniffer(stream);
             }
             else {
@@ -80,6 +83,43 @@ int main(int argc, const char* argv[]) {
 
         std::string interface_name = parsed_cfg["interface"];
 
+        if (parsed_cfg.count("smb_skip_signed")) {
+            cs::samba::Sniffer::set_skip_signed_session(parsed_cfg["smb_skip_signed"] == "true");
+        }
+        if (parsed_cfg.count("smb_pipe_only_limit")) {
+            cs::samba::Sniffer::set_pipe_only_msg_limit(std::stoull(parsed_cfg["smb_pipe_only_limit"]));
+        }
+        if (parsed_cfg.count("smb_idle_timeout")) {
+            cs::samba::Sniffer::set_idle_timeout(std::stoull(parsed_cfg["smb_idle_timeout"]));
+        }
+        if (parsed_cfg.count("smb_emit_ratio")) {
+            cs::samba::Sniffer::set_emit_ratio(std::stod(parsed_cfg["smb_emit_ratio"]));
+        }
+        if (parsed_cfg.count("http_capture_types")) {
+            cs::http::Sniffer::set_capture_types(cs::util::split_str(parsed_cfg["http_capture_types"], ","));
+        }
+        if (parsed_cfg.count("http_capture_min_size")) {
+            cs::http::Sniffer::set_capture_min_size(std::stoull(parsed_cfg["http_capture_min_size"]));
+        }
+        if (parsed_cfg.count("http_capture_max_size")) {
+            cs::http::Sniffer::set_capture_max_size(std::stoull(parsed_cfg["http_capture_max_size"]));
+        }
+        if (parsed_cfg.count("http_range_idle_timeout")) {
+            cs::http::RangeTable::set_idle_timeout(std::stoull(parsed_cfg["http_range_idle_timeout"]));
+        }
+        if (parsed_cfg.count("http_max_decode_ratio")) {
+            cs::http::ContentDecoder::set_max_ratio(std::stoull(parsed_cfg["http_max_decode_ratio"]));
+        }
+        if (parsed_cfg.count("ftp_expect_timeout")) {
+            cs::ftp::ExpectationTable::set_expire_timeout(std::stoull(parsed_cfg["ftp_expect_timeout"]));
+        }
+        if (parsed_cfg.count("file_map_threshold")) {
+            cs::util::File::set_map_threshold(std::stoull(parsed_cfg["file_map_threshold"]));
+        }
+        if (parsed_cfg.count("file_huge_pages")) {
+            cs::util::File::set_huge_pages(parsed_cfg["file_huge_pages"] == "true");
+        }
+
         cs::threads::start_threads(2);
 
         Tins::SnifferConfiguration config;
@@ -93,7 +133,22 @@ int main(int argc, const char* argv[]) {
         follower.new_stream_callback(&on_new_connection);
         follower.stream_termination_callback(on_connection_terminated);
 
+        auto last_tick = std::chrono::steady_clock::now();
+        auto last_statistics = last_tick;
+
         sniffer.sniff_loop([&](Tins::PDU& packet) {
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_tick >= std::chrono::seconds(1)) {
+                cs::SNIFFER_MANAGER.tick(now);
+                cs::http::RANGE_TABLE.tick(now);
+                cs::ftp::EXPECTATION_TABLE.tick(now);
+                last_tick = now;
+            }
+            if (now - last_statistics >= std::chrono::minutes(1)) {
+                cs::util::STATISTICS.log();
+                last_statistics = now;
+            }
+
             Tins::PDU* layer2_pdu = &packet;
             Tins::PDU* layer3_pdu = layer2_pdu->inner_pdu();
             Tins::PDU* layer4_pdu = layer3_pdu->inner_pdu();
@@ -6,14 +6,20 @@ namespace cs {
 namespace samba {
 
 CollectedData::CollectedData(
-        cs::util::File* file) :
+        cs::util::File* file,
+        uint64_t version) :
         cs::base::CollectedData(DataType::SAMBA) {
     file_ = file;
+    version_ = version;
 }
 
 cs::util::File* CollectedData::get_data() const {
     return file_;
 }
+
+uint64_t CollectedData::get_version() const {
+    return version_;
+}
 CollectedData::~CollectedData() {
     delete file_;
 }
@@ -3,6 +3,7 @@
 
 
 #include <string>
+#include <cstdint>
 #include "base/collected_data.hpp"
 
 namespace cs {
@@ -19,16 +20,20 @@ class CollectedData: public cs::base::CollectedData {
 
 public:
 
-    CollectedData(cs::util::File*);
+    CollectedData(cs::util::File*, uint64_t);
 
     cs::util::File* get_data() const;
 
+    uint64_t get_version() const;
+
     virtual ~CollectedData();
 
 private:
 
     cs::util::File* file_;
 
+    uint64_t version_;
+
 };
 
 }
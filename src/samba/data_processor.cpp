@@ -17,8 +17,12 @@ int DataProcessor::process(cs::base::CollectedData* sniffer_data_ptr) {
     cs::util::File* file = sniffer_data.get_data();
 
     LOG_INFO << "SAMBA file name " << file -> get_name();
+    LOG_INFO << "SAMBA file version " << sniffer_data.get_version();
     LOG_INFO << "SAMBA file size " << file -> get_size();
-    LOG_INFO << "SAMBA file md5 " << file -> get_md5();
+    const cs::util::Digest& digest = file -> get_digest();
+    LOG_INFO << "SAMBA file md5 " << digest.md5;
+    LOG_INFO << "SAMBA file sha1 " << digest.sha1;
+    LOG_INFO << "SAMBA file sha256 " << digest.sha256;
 
 
     return 1;
@@ -1,6 +1,7 @@
 #include "samba/sniffer.hpp"
 
 #include <vector>
+#include <algorithm>
 #include <sstream>
 #include <iomanip>
 #include <cstring>
@@ -12,80 +13,158 @@
 #include "cuckoo_sniffer.hpp"
 #include "sniffer_manager.hpp"
 #include "util/file.hpp"
+#include "util/hash.hpp"
+#include "util/magic.hpp"
 #include "samba/collected_data.hpp"
 #include "samba/data_processor.hpp"
 
 namespace cs {
 namespace samba {
 
+static const std::string RELATED_FILE_ID = "ffffffff-ffff-ffff-ffff-ffffffffffff";
+
+bool Sniffer::skip_signed_session_ = false;
+
+//a session that only talks to pipes for this long carries no files worth waiting for
+uint64_t Sniffer::pipe_only_msg_limit_ = 64;
+
+//early emission is opt-in, an open file emitted early is held twice until it is closed
+uint64_t Sniffer::idle_timeout_ = 0;
+
+double Sniffer::emit_ratio_ = 0;
+
+void Sniffer::set_skip_signed_session(bool skip) {
+    skip_signed_session_ = skip;
+}
+
+void Sniffer::set_pipe_only_msg_limit(uint64_t limit) {
+    pipe_only_msg_limit_ = limit;
+}
+
+void Sniffer::set_idle_timeout(uint64_t seconds) {
+    idle_timeout_ = seconds;
+}
+
+void Sniffer::set_emit_ratio(double ratio) {
+    emit_ratio_ = ratio;
+}
+
 void Sniffer::on_client_payload(const Tins::TCPIP::Stream& stream) {
-    std::vector<uint8_t> vec = std::vector<uint8_t>(stream.client_payload());
-    while (vec.size() > 0) {
-        vec = handle_client_NB_block(vec);
-    }
-}
-
-std::vector<uint8_t> Sniffer::handle_client_NB_block(const std::vector<uint8_t>& vec) {
-    uint64_t payload_len = vec.size();
-    if (client_NB_block_remain_ <=0) {
-        uint64_t block_size = (vec[1] << 16) + (vec[2] << 8) + vec[3];
-        if (block_size <= payload_len) {
-            handle_client_req(std::vector<uint8_t>(
-                    vec.begin() + 4,
-                    vec.begin() + 4 + block_size
-            ));
-            return std::vector<uint8_t>(
-                    vec.begin() + 4 + block_size,
-                    vec.end()
-            );
+    const std::vector<uint8_t>& payload = stream.client_payload();
+    const uint8_t* data = payload.data();
+    uint64_t len = payload.size();
+    while (len > 0 && !abandoned_) {
+        uint64_t consumed = handle_client_NB_block(data, len);
+        data += consumed;
+        len -= consumed;
+    }
+}
+
+uint64_t Sniffer::handle_client_NB_block(const uint8_t* data, uint64_t len) {
+    return handle_NB_block(
+            data,
+            len,
+            client_NB_block_remain_,
+            client_NB_block_,
+            &Sniffer::handle_client_req
+    );
+}
+
+uint64_t Sniffer::handle_NB_block(
+        const uint8_t* data,
+        uint64_t len,
+        uint64_t& block_remain,
+        std::vector<uint8_t>& block,
+        void (Sniffer::*handler)(const uint8_t*, uint64_t)) {
+
+    if (block_remain > 0) {
+        uint64_t copy_len = std::min(block_remain, len);
+        if (block.empty() && copy_len >= 4 && is_transform_header(data)) {
+            abandon("SMB3 transform header");
+            return len;
         }
-        else {
-            client_NB_block_remain_ = block_size - (payload_len - 4);
-            client_NB_block_.insert(
-                    client_NB_block_.end(),
-                    vec.begin() + 4,
-                    vec.end()
-            );
-            return std::vector<uint8_t>();
-        }
-    }
-    else {
-        if (client_NB_block_remain_ <= payload_len) {
-            client_NB_block_.insert(
-                    client_NB_block_.end(),
-                    vec.begin(),
-                    vec.begin() + client_NB_block_remain_
-            );
-            handle_client_req(client_NB_block_);
-            client_NB_block_.clear();
-            uint64_t tmp = client_NB_block_remain_;
-            client_NB_block_remain_ = 0;
-            return std::vector<uint8_t>(
-                    vec.begin() + tmp,
-                    vec.end()
-            );
+        block.insert(block.end(), data, data + copy_len);
+        block_remain -= copy_len;
+        if (block_remain == 0) {
+            (this->*handler)(block.data(), block.size());
+            block.clear();
         }
-        else {
-            client_NB_block_.insert(
-                    client_NB_block_.end(),
-                    vec.begin(),
-                    vec.begin() + payload_len
-            );
-            client_NB_block_remain_ -= payload_len;
-            return std::vector<uint8_t>();
+        return copy_len;
+    }
+
+    //the NetBIOS session header itself is split between segments
+    if (!block.empty() || len < NB_HEADER_SIZE) {
+        uint64_t copy_len = std::min(NB_HEADER_SIZE - block.size(), len);
+        block.insert(block.end(), data, data + copy_len);
+        if (block.size() == NB_HEADER_SIZE) {
+            block_remain = (block[1] << 16) + (block[2] << 8) + block[3];
+            block.clear();
+            block.reserve(block_remain);
         }
+        return copy_len;
+    }
 
+    uint64_t block_size = (data[1] << 16) + (data[2] << 8) + data[3];
+    //encrypted, drop the flow before copying anything of the block
+    if (len >= NB_HEADER_SIZE + 4 && is_transform_header(data + NB_HEADER_SIZE)) {
+        abandon("SMB3 transform header");
+        return len;
+    }
+    if (NB_HEADER_SIZE + block_size <= len) {
+        //whole block is in this segment, parse it in place
+        (this->*handler)(data + NB_HEADER_SIZE, block_size);
+        return NB_HEADER_SIZE + block_size;
     }
+
+    block.reserve(block_size);
+    block.insert(block.end(), data + NB_HEADER_SIZE, data + len);
+    block_remain = block_size - (len - NB_HEADER_SIZE);
+    return len;
 }
 
-void Sniffer::handle_client_req(const std::vector<uint8_t>& vec) {
+void Sniffer::handle_client_req(const uint8_t* data, uint64_t len) {
+
+    //walk the compound chain, NextCommand is relative to the current header
+    uint64_t offset = 0;
+    uint64_t chain_create_msg_id = 0;
+    while (offset + SMB2_HEADER_SIZE <= len) {
+        const uint8_t* msg = data + offset;
+        if (is_transform_header(msg)) {
+            abandon("SMB3 transform header");
+            return;
+        }
+        if (!is_smb2_header(msg)) {
+            return;
+        }
+        uint64_t next_command = get_number(msg, 20, 4);
+        uint64_t msg_len = next_command != 0 ? next_command : len - offset;
+        if (msg_len < SMB2_HEADER_SIZE || msg_len > len - offset) {
+            return;
+        }
+
+        if (get_number(msg, 12, 2) == CREATE) {
+            chain_create_msg_id = get_number(msg, 24, 8);
+        }
+        handle_client_msg(msg, msg_len, chain_create_msg_id);
+
+        if (abandoned_ || next_command == 0) {
+            break;
+        }
+        offset += next_command;
+    }
+}
+
+void Sniffer::handle_client_msg(const uint8_t* vec, uint64_t len, uint64_t chain_create_msg_id) {
 
     uint64_t header_length = vec[4] + (vec[5] << 8);
     uint64_t command = vec[12] + (vec[13] << 8);
     uint64_t flags = get_number(vec, 16, 4);
 
-    bool resp_flag = static_cast<bool>(flags & 1); // 1 Response 0 Request
-    bool DFS_op_flag = static_cast<bool>(flags & 1<<28);
+    bool resp_flag = static_cast<bool>(flags & SERVER_TO_REDIR); // 1 Response 0 Request
+    bool DFS_op_flag = static_cast<bool>(flags & DFS_OPERATIONS);
+    bool related_flag = static_cast<bool>(flags & RELATED_OPERATIONS);
+    bool async_flag = static_cast<bool>(flags & ASYNC_COMMAND);
+    bool signed_flag = static_cast<bool>(flags & SIGNED);
 
     uint64_t msg_id = get_number(vec, 24, 8);
 
@@ -93,9 +172,26 @@ void Sniffer::handle_client_req(const std::vector<uint8_t>& vec) {
         return;
     }
 
+    if (skip_signed_session_ && signed_flag && command != SESSION_SETUP) {
+        abandon("signed session");
+        return;
+    }
+
+    //nothing on a pipe or printer share is a file we can extract
+    uint64_t tree_id = get_number(vec, 36, 4);
+    if (!async_flag && pipe_tree_id_.find(tree_id) != pipe_tree_id_.end()) {
+        if (!disk_tree_connected_ && pipe_only_msg_limit_ > 0 && ++pipe_only_msg_ >= pipe_only_msg_limit_) {
+            abandon("pipe-only connection");
+        }
+        return;
+    }
+
     //create request
     if (command == CREATE){
         uint64_t create_req_offset = header_length;
+        if (len < create_req_offset + 56) {
+            return;
+        }
         //check file_attributes
         if (vec[create_req_offset + 28] != 0x80) {
             return;
@@ -107,6 +203,9 @@ void Sniffer::handle_client_req(const std::vector<uint8_t>& vec) {
 
         uint64_t file_name_offset = vec[create_req_offset + 44] + (vec[create_req_offset + 45] << 8);
         uint64_t file_name_len = vec[create_req_offset+ 46] + (vec[create_req_offset + 47] << 8);
+        if (file_name_offset + file_name_len > len) {
+            return;
+        }
         std::string file_name = get_file_name(vec, file_name_offset, file_name_len);
         if (file_name.find(':') != std::string::npos) {
             return;
@@ -123,10 +222,18 @@ void Sniffer::handle_client_req(const std::vector<uint8_t>& vec) {
     //read request
     else if (command == READ ) {
         uint64_t read_req_offset = header_length;
+        if (len < read_req_offset + 32) {
+            return;
+        }
         uint64_t read_length = get_number(vec, read_req_offset + 4, 4);
         uint64_t read_offset = get_number(vec, read_req_offset + 8, 8);
         std::string file_id = get_file_handle(vec, read_req_offset + 16);
 
+        if (related_flag && file_id == RELATED_FILE_ID) {
+            related_req_map_[msg_id] = chain_create_msg_id;
+            related_file_id_.insert(std::make_pair(chain_create_msg_id, RELATED_FILE_ID));
+        }
+
         read_req_map_.insert(std::make_pair(
                 msg_id,
                 std::make_tuple(
@@ -146,19 +253,30 @@ void Sniffer::handle_client_req(const std::vector<uint8_t>& vec) {
     else if (command == WRITE) {
 
         uint64_t write_req_offset = header_length;
+        if (len < write_req_offset + 32) {
+            return;
+        }
         uint64_t data_offset = get_number(vec, write_req_offset + 2, 2);
         uint64_t write_len = get_number(vec, write_req_offset + 4, 4);
         uint64_t write_offset = get_number(vec, write_req_offset + 8, 8);
         std::string file_id = get_file_handle(vec, write_req_offset + 16);
 
-        if (file_info_.find(file_id) == file_info_.end()) {
+        if (related_flag && file_id == RELATED_FILE_ID) {
+            related_req_map_[msg_id] = chain_create_msg_id;
+            related_file_id_.insert(std::make_pair(chain_create_msg_id, RELATED_FILE_ID));
+        }
+        else if (file_info_.find(file_id) == file_info_.end()) {
+            return;
+        }
+
+        if (data_offset + write_len > len) {
             return;
         }
 
         char *p_data = new char[write_len];
         memcpy(
                 p_data,
-                reinterpret_cast<const char *>(vec.data() + data_offset),
+                reinterpret_cast<const char *>(vec + data_offset),
                 sizeof(char) * write_len
         );
 
@@ -180,7 +298,16 @@ void Sniffer::handle_client_req(const std::vector<uint8_t>& vec) {
     //close request
     else if (command == CLOSE) {
         uint64_t close_req_offset = header_length;
+        if (len < close_req_offset + 24) {
+            return;
+        }
         std::string file_id = get_file_handle(vec, close_req_offset + 8);
+
+        if (related_flag && file_id == RELATED_FILE_ID) {
+            related_req_map_[msg_id] = chain_create_msg_id;
+            related_file_id_.insert(std::make_pair(chain_create_msg_id, RELATED_FILE_ID));
+        }
+
         LOG_TRACE << "SAMBA client close req, id " << msg_id;
         LOG_TRACE << "SAMBA client close req, file id " << file_id;
         close_msg_.insert(std::make_pair(
@@ -191,86 +318,116 @@ void Sniffer::handle_client_req(const std::vector<uint8_t>& vec) {
 }
 
 void Sniffer::on_server_payload(const Tins::TCPIP::Stream &stream) {
-    std::vector<uint8_t> vec = std::vector<uint8_t>(stream.server_payload());
-    while (vec.size() > 0) {
-        vec = handle_server_NB_block(vec);
-    }
-}
-
-std::vector<uint8_t> Sniffer::handle_server_NB_block(const std::vector<uint8_t>& vec) {
-    uint64_t payload_len = vec.size();
-    if (server_NB_block_remain_ <=0) {
-        uint64_t block_size = (vec[1] << 16) + (vec[2] << 8) + vec[3];
-        if (block_size <= payload_len) {
-            handle_server_resp(std::vector<uint8_t>(
-                    vec.begin() + 4,
-                    vec.begin() + 4 + block_size
-            ));
-            return std::vector<uint8_t>(
-                    vec.begin() + 4 + block_size,
-                    vec.end()
-            );
+    const std::vector<uint8_t>& payload = stream.server_payload();
+    const uint8_t* data = payload.data();
+    uint64_t len = payload.size();
+    while (len > 0 && !abandoned_) {
+        uint64_t consumed = handle_server_NB_block(data, len);
+        data += consumed;
+        len -= consumed;
+    }
+}
+
+uint64_t Sniffer::handle_server_NB_block(const uint8_t* data, uint64_t len) {
+    return handle_NB_block(
+            data,
+            len,
+            server_NB_block_remain_,
+            server_NB_block_,
+            &Sniffer::handle_server_resp
+    );
+}
+
+void Sniffer::handle_server_resp(const uint8_t* data, uint64_t len) {
+
+    uint64_t offset = 0;
+    while (offset + SMB2_HEADER_SIZE <= len) {
+        const uint8_t* msg = data + offset;
+        if (is_transform_header(msg)) {
+            abandon("SMB3 transform header");
+            return;
         }
-        else {
-            server_NB_block_remain_ = block_size - (payload_len - 4);
-            server_NB_block_.insert(
-                    server_NB_block_.end(),
-                    vec.begin() + 4,
-                    vec.end()
-            );
-            return std::vector<uint8_t>();
-        }
-    }
-    else {
-        if (server_NB_block_remain_ <= payload_len) {
-            server_NB_block_.insert(
-                    server_NB_block_.end(),
-                    vec.begin(),
-                    vec.begin() + server_NB_block_remain_
-            );
-            handle_server_resp(server_NB_block_);
-            server_NB_block_.clear();
-            uint64_t tmp = server_NB_block_remain_;
-            server_NB_block_remain_ = 0;
-            return std::vector<uint8_t>(
-                    vec.begin() + tmp,
-                    vec.end()
-            );
+        if (!is_smb2_header(msg)) {
+            return;
         }
-        else {
-            server_NB_block_.insert(
-                    server_NB_block_.end(),
-                    vec.begin(),
-                    vec.begin() + payload_len
-            );
-            server_NB_block_remain_ -= payload_len;
-            return std::vector<uint8_t>();
+        uint64_t next_command = get_number(msg, 20, 4);
+        uint64_t msg_len = next_command != 0 ? next_command : len - offset;
+        if (msg_len < SMB2_HEADER_SIZE || msg_len > len - offset) {
+            return;
+        }
+
+        handle_server_msg(msg, msg_len);
+
+        if (abandoned_ || next_command == 0) {
+            break;
         }
+        offset += next_command;
     }
 }
 
-void Sniffer::handle_server_resp(const std::vector<uint8_t>& vec) {
+void Sniffer::handle_server_msg(const uint8_t* vec, uint64_t len) {
 
     uint64_t header_length = vec[4] + (vec[5] << 8);
+    uint64_t nt_status = get_number(vec, 8, 4);
     uint64_t command = vec[12] + (vec[13] << 8);
     uint64_t flags = get_number(vec, 16, 4);
 
-    bool resp_flag = static_cast<bool>(flags & 1); // 1 Response 0 Request
-    bool DFS_op_flag = static_cast<bool>(flags & 1<<28);
+    bool resp_flag = static_cast<bool>(flags & SERVER_TO_REDIR); // 1 Response 0 Request
+    bool DFS_op_flag = static_cast<bool>(flags & DFS_OPERATIONS);
+    bool async_flag = static_cast<bool>(flags & ASYNC_COMMAND);
 
     uint64_t msg_id = get_number(vec, 24, 8);
 
     if (!resp_flag || DFS_op_flag) {
         return;
     }
+
+    if (async_flag) {
+        uint64_t async_id = get_number(vec, 32, 8);
+        //interim response, the final one follows with the same async id
+        if (nt_status == STATUS_PENDING) {
+            async_msg_map_[async_id] = msg_id;
+            LOG_TRACE << "SAMBA server interim resp, id " << msg_id << ", async id " << async_id;
+            return;
+        }
+        auto async_iter = async_msg_map_.find(async_id);
+        if (async_iter != async_msg_map_.end()) {
+            msg_id = async_iter -> second;
+            async_msg_map_.erase(async_iter);
+        }
+    }
+
+    //tree connect response
+    if (command == TREE_CONNECT) {
+        uint64_t tree_resp_offset = header_length;
+        if (nt_status != STATUS_SUCCESS || async_flag || len < tree_resp_offset + 16) {
+            return;
+        }
+        uint64_t tree_id = get_number(vec, 36, 4);
+        uint64_t share_type = vec[tree_resp_offset + 2];
+        if (share_type == SHARE_TYPE_DISK) {
+            disk_tree_connected_ = true;
+        }
+        else {
+            pipe_tree_id_.insert(tree_id);
+        }
+        LOG_TRACE << "SAMBA server tree connect resp, tree id " << tree_id << ", share type " << share_type;
+    }
     //create response
-    if (command == CREATE){
-        if (create_req_file_name_.find(msg_id) == create_req_file_name_.end()) {
+    else if (command == CREATE){
+        auto name_iter = create_req_file_name_.find(msg_id);
+        if (name_iter == create_req_file_name_.end()) {
+            return;
+        }
+        std::string file_name = name_iter -> second;
+        create_req_file_name_.erase(name_iter);
+
+        if (nt_status != STATUS_SUCCESS) {
             return;
         }
         uint64_t create_resp_offset = header_length;
         uint64_t struct_size = get_number(vec, create_resp_offset, 2);
-        if (struct_size < 80) {
+        if (struct_size < 80 || len < create_resp_offset + 80) {
             return;
         }
 
@@ -289,12 +446,17 @@ void Sniffer::handle_server_resp(const std::vector<uint8_t>& vec) {
                 std::make_pair(
                         file_id,
                         std::make_pair(
-                                create_req_file_name_[msg_id],
+                                file_name,
                                 file_eof
                         )
                 )
         );
 
+        auto related_iter = related_file_id_.find(msg_id);
+        if (related_iter != related_file_id_.end()) {
+            related_iter -> second = file_id;
+        }
+
         LOG_TRACE << "SAMBA server create resp, id " << msg_id;
         LOG_TRACE << "SAMBA server create resp, file allloc size " << file_allocation_size;
         LOG_TRACE << "SAMBA server create resp, file eof " << file_eof;
@@ -302,115 +464,341 @@ void Sniffer::handle_server_resp(const std::vector<uint8_t>& vec) {
     }
         //read response
     else if (command == READ ) {
+        auto iter = read_req_map_.find(msg_id);
+        if (iter == read_req_map_.end()) {
+            return;
+        }
+        auto tuple = iter -> second;
+        read_req_map_.erase(iter);
+        std::string file_id = resolve_file_id(msg_id, std::get<0>(tuple));
+
         uint64_t read_resp_offset = header_length;
-        uint64_t data_offset = vec[read_resp_offset + 2] + (vec[read_resp_offset + 3] << 8);
+        if (nt_status != STATUS_SUCCESS || file_id == RELATED_FILE_ID || len < read_resp_offset + 16) {
+            return;
+        }
+        uint64_t data_offset = vec[read_resp_offset + 2];
         uint64_t read_len = get_number(vec, read_resp_offset + 4, 4);
-        uint64_t read_remain = get_number(vec, read_resp_offset + 8, 8);
+        if (data_offset + read_len > len) {
+            return;
+        }
+
+        //already emitted in an earlier version of this open
+        auto state_iter = file_state_.find(file_id);
+        if (state_iter != file_state_.end() &&
+            state_iter -> second.emitted.contains(std::get<2>(tuple), read_len)) {
+            return;
+        }
 
         char *p_data = new char[read_len];
         memcpy(
                 p_data,
-                reinterpret_cast<const char *>(vec.data() + data_offset),
+                reinterpret_cast<const char *>(vec + data_offset),
                 sizeof(char) * read_len
         );
 
         LOG_TRACE << "SAMBA server read resp, id " << msg_id;
         LOG_TRACE << "SAMBA server read resp, read length " << read_len;
 
-        auto iter = read_req_map_.find(msg_id);
-        auto tuple = iter -> second;
-        rw_result_map_.insert(std::make_pair(
-                std::get<0>(tuple),  //file id
-                std::make_tuple(
-                        std::get<1>(tuple),  //len
-                        std::get<2>(tuple),  //offset
-                        p_data
-                )
-        ));
-        read_req_map_.erase(iter);
+        add_result(file_id, read_len, std::get<2>(tuple), p_data);
     }
         //write response
     else if (command == WRITE) {
-        uint64_t nt_success = get_number(vec, 8, 4);
-        if (nt_success != 0) {
-            return;
-        }
         auto iter = write_req_map_.find(msg_id);
         if (iter == write_req_map_.end()) {
             return;
         }
-        LOG_TRACE << "SAMBA server write resp, id " << msg_id;
         auto tuple = iter -> second;
-        rw_result_map_.insert(std::make_pair(
-                std::get<0>(tuple),  //file id
-                std::make_tuple(
-                        std::get<1>(tuple),  //len
-                        std::get<2>(tuple),  //offset
-                        std::get<3>(tuple)
-                )
-        ));
         write_req_map_.erase(iter);
+        std::string file_id = resolve_file_id(msg_id, std::get<0>(tuple));
+        if (nt_status != STATUS_SUCCESS || file_info_.find(file_id) == file_info_.end()) {
+            delete[] std::get<3>(tuple);
+            return;
+        }
+        LOG_TRACE << "SAMBA server write resp, id " << msg_id;
+        add_result(file_id, std::get<1>(tuple), std::get<2>(tuple), std::get<3>(tuple));
     }
         //close response
     else if (command == CLOSE) {
         LOG_TRACE << "SAMBA server close resp, id " << msg_id;
-        uint64_t nt_success = get_number(vec, 8, 4);
-        LOG_TRACE << "SAMBA server close resp, nt success " << nt_success;
-        if (nt_success != 0) {
+        auto iter = close_msg_.find(msg_id);
+        if (iter == close_msg_.end()) {
             return;
         }
-
-        auto iter = close_msg_.find(msg_id);
-        std::string file_id = iter -> second;
+        std::string file_id = resolve_file_id(msg_id, iter -> second);
         close_msg_.erase(iter);
 
-//        LOG_TRACE << "SAMBA server close resp, file id " << file_id;
-//        for (auto i: rw_result_map_) {
-//            LOG_TRACE << i.first;
-//        }
-        combine_data(file_id);
+        LOG_TRACE << "SAMBA server close resp, nt success " << nt_status;
+        if (nt_status != STATUS_SUCCESS) {
+            return;
+        }
+
+        combine_data(file_id, true);
+        erase_file_state(file_id);
+        file_info_.erase(file_id);
+    }
+}
+
+bool Sniffer::is_transform_header(const uint8_t* msg) {
+    return msg[0] == 0xFD && msg[1] == 'S' && msg[2] == 'M' && msg[3] == 'B';
+}
+
+bool Sniffer::is_smb2_header(const uint8_t* msg) {
+    return msg[0] == 0xFE && msg[1] == 'S' && msg[2] == 'M' && msg[3] == 'B';
+}
+
+void Sniffer::abandon(const char* reason) {
+    LOG_DEBUG << id_ << " SAMBA abandon connection, " << reason;
+    abandoned_ = true;
+    release_pending();
+}
+
+void Sniffer::abandon_stream(Tins::TCPIP::Stream& stream) {
+    stream.ignore_client_data();
+    stream.ignore_server_data();
+}
+
+void Sniffer::release_pending() {
+    for (auto& iter: write_req_map_) {
+        delete[] std::get<3>(iter.second);
+    }
+    for (auto& iter: rw_result_map_) {
+        delete[] std::get<2>(iter.second);
+    }
+    write_req_map_.clear();
+    rw_result_map_.clear();
+    for (auto& iter: file_state_) {
+        delete iter.second.hasher;
+        delete iter.second.content;
+    }
+    file_state_.clear();
+    read_req_map_.clear();
+    create_req_file_name_.clear();
+    close_msg_.clear();
+    file_info_.clear();
+    related_req_map_.clear();
+    related_file_id_.clear();
+    async_msg_map_.clear();
+    pipe_tree_id_.clear();
+
+    client_NB_block_remain_ = 0;
+    std::vector<uint8_t>().swap(client_NB_block_);
+    server_NB_block_remain_ = 0;
+    std::vector<uint8_t>().swap(server_NB_block_);
+}
+
+void Sniffer::add_result(const std::string& file_id, uint64_t len, uint64_t offset, char* p_data) {
+    FileState& state = get_file_state(file_id);
+
+    //decided on the header alone, images and media are not collected any further
+    if (!state.skipped && offset == 0 && len > 0) {
+        cs::util::MagicType magic = cs::util::classify_magic(p_data, len);
+        if (cs::util::is_unwanted_magic(magic)) {
+            LOG_DEBUG << "SAMBA " << file_id << " is " << cs::util::get_magic_mime_type(magic) << ", skipped.";
+            state.skipped = true;
+            auto range = rw_result_map_.equal_range(file_id);
+            for (auto i = range.first; i != range.second; ++i) {
+                delete[] std::get<2>(i -> second);
+            }
+            rw_result_map_.erase(file_id);
+            state.pending.clear();
+        }
+    }
+    if (state.skipped) {
+        delete[] p_data;
+        return;
+    }
+
+    rw_result_map_.insert(std::make_pair(
+            file_id,
+            std::make_tuple(
+                    len,
+                    offset,
+                    p_data
+            )
+    ));
+
+    update_hash(state, offset, len, p_data);
+    state.buffered.add(offset, len);
+    state.last_io = std::chrono::steady_clock::now();
+
+    //enough of the file is here, do not wait for CLOSE
+    auto info_iter = file_info_.find(file_id);
+    if (emit_ratio_ > 0 && info_iter != file_info_.end() && info_iter -> second.second > 0 &&
+        state.buffered.get_covered() >= emit_ratio_ * info_iter -> second.second) {
+        LOG_TRACE << "SAMBA emit " << file_id << ", covered " << state.buffered.get_covered();
+        combine_data(file_id, false);
+    }
+}
+
+Sniffer::FileState& Sniffer::get_file_state(const std::string& file_id) {
+    auto iter = file_state_.find(file_id);
+    if (iter == file_state_.end()) {
+        FileState state;
+        state.hasher = nullptr;
+        state.version = 0;
+        state.skipped = false;
+        state.content = nullptr;
+        iter = file_state_.insert(std::make_pair(file_id, state)).first;
+        reset_hash(iter -> second);
+    }
+    return iter -> second;
+}
+
+void Sniffer::reset_hash(FileState& state) {
+    delete state.hasher;
+    state.hasher = new cs::util::Hasher();
+    state.hashed_end = 0;
+    state.in_order = true;
+    state.pending.clear();
+}
+
+void Sniffer::update_hash(FileState& state, uint64_t offset, uint64_t len, const char* data) {
+    if (len == 0 || !state.in_order) {
+        return;
+    }
+
+    //overlapping or rewritten data, leave it to the final pass
+    if (offset < state.hashed_end || state.pending.find(offset) != state.pending.end()) {
+        state.in_order = false;
+        state.pending.clear();
+        return;
+    }
+    if (offset > state.hashed_end) {
+        state.pending[offset] = std::make_pair(len, data);
+        return;
+    }
 
+    state.hasher -> update(data, len);
+    state.hashed_end += len;
+    for (auto p = state.pending.begin();
+         p != state.pending.end() && p -> first <= state.hashed_end;
+         p = state.pending.begin()) {
+        if (p -> first < state.hashed_end) {
+            state.in_order = false;
+            state.pending.clear();
+            return;
+        }
+        state.hasher -> update(p -> second.second, p -> second.first);
+        state.hashed_end += p -> second.first;
+        state.pending.erase(p);
+    }
+}
+
+void Sniffer::erase_file_state(const std::string& file_id) {
+    auto iter = file_state_.find(file_id);
+    if (iter != file_state_.end()) {
+        delete iter -> second.hasher;
+        delete iter -> second.content;
+        file_state_.erase(iter);
     }
 }
 
-void Sniffer::combine_data(const std::string& file_id) {
+std::string Sniffer::resolve_file_id(uint64_t msg_id, const std::string& file_id) {
+    if (file_id != RELATED_FILE_ID) {
+        return file_id;
+    }
+    auto iter = related_req_map_.find(msg_id);
+    if (iter == related_req_map_.end()) {
+        return file_id;
+    }
+    uint64_t create_msg_id = iter -> second;
+    related_req_map_.erase(iter);
+
+    auto file_iter = related_file_id_.find(create_msg_id);
+    if (file_iter == related_file_id_.end()) {
+        return file_id;
+    }
+    std::string resolved = file_iter -> second;
+
+    //drop the CREATE entry once no related operation refers to it
+    bool referenced = false;
+    for (const auto& i: related_req_map_) {
+        if (i.second == create_msg_id) {
+            referenced = true;
+            break;
+        }
+    }
+    if (!referenced) {
+        related_file_id_.erase(file_iter);
+    }
+    return resolved;
+}
+
+static cs::util::File* copy_file(const cs::util::File& file) {
+    cs::util::File* copy = new cs::util::File();
+    copy -> set_name(file.get_name());
+    copy -> set_size(file.get_size());
+    for (const auto& slice: file.get_slices()) {
+        copy -> write(slice.data, slice.size);
+    }
+    return copy;
+}
+
+//emits the file as it stands, the I/O buffered since the last version merged
+//over what earlier versions held, closing hands the content over without a copy
+void Sniffer::combine_data(const std::string& file_id, bool closing) {
 
     auto range = rw_result_map_.equal_range(file_id);
-    if (range.first == rw_result_map_.end()) {
+    if (range.first == range.second) {
         LOG_TRACE << "SAMBA server close resp, result_map is empty.";
         return;
     }
     std::pair<std::string, uint64_t>& i_file_info = file_info_[file_id];
     std::string file_name = i_file_info.first;
+    FileState& state = get_file_state(file_id);
 
-    uint64_t file_size = 0;
+    if (state.content == nullptr) {
+        state.content = new cs::util::File();
+        state.content -> set_name(file_name);
+    }
+    LOG_TRACE << "Copying " << file_name << ", version " << state.version;
     for (auto i = range.first; i != range.second; ++i) {
-        file_size += std::get<0>(i -> second);
+        uint64_t len = std::get<0>(i -> second);
+        uint64_t offset = std::get<1>(i -> second);
+        char* p_data = std::get<2>(i -> second);
+        LOG_TRACE << "Offset " << offset << ", len " << len;
+        state.content -> write_to_pos(p_data, len, offset);
+        state.emitted.add(offset, len);
+        delete[] p_data;
     }
-    if (file_size > 0) {
+    rw_result_map_.erase(file_id);
 
-        LOG_TRACE << "Copying " << file_name << ",size " << file_size;
-        cs::util::File* file = new cs::util::File();
-        file -> set_name(file_name);
-        file -> set_size(file_size);
+    if (state.content -> get_size() > 0) {
+        cs::util::File* file = state.content;
+        if (closing)
+            state.content = nullptr;
+        else
+            file = copy_file(*file);
 
-        for (auto i = range.first; i != range.second; ++i) {
-            uint64_t len = std::get<0>(i -> second);
-            uint64_t offset = std::get<1>(i -> second);
-            char* p_data = std::get<2>(i -> second);
-            LOG_TRACE << "Offset " << offset << ", len " << len;
-            file -> write_to_pos(p_data, len, offset);
-            delete[] p_data;
+        //the in-order hash only covers the file if this version rewrote all of it
+        if (state.in_order && state.pending.empty() && state.hashed_end == file -> get_size()) {
+            file -> set_digest(state.hasher -> finish());
         }
 
         DATA_QUEUE.enqueue(new CollectedData(
-                file
+                file,
+                state.version
         ));
-
     }
-    rw_result_map_.erase(file_id);
+
+    //later I/O on the same open makes up the next version
+    state.buffered.clear();
+    reset_hash(state);
+    ++state.version;
 }
 
+void Sniffer::on_tick(const std::chrono::steady_clock::time_point& now) {
+    if (idle_timeout_ == 0) {
+        return;
+    }
+    for (auto& iter: file_state_) {
+        if (!iter.second.buffered.empty() &&
+            now - iter.second.last_io >= std::chrono::seconds(idle_timeout_)) {
+            LOG_TRACE << "SAMBA emit idle " << iter.first;
+            combine_data(iter.first, false);
+        }
+    }
+}
 
 void Sniffer::on_connection_close(const Tins::TCPIP::Stream &stream) {
     LOG_DEBUG << "SAMBA onnection Close";
@@ -422,7 +810,7 @@ void Sniffer::on_connection_close(const Tins::TCPIP::Stream &stream) {
         );
     }
     for (auto &iter: s) {
-        combine_data(iter);
+        combine_data(iter, true);
     }
 
     SNIFFER_MANAGER.erase_sniffer(id_);
@@ -439,14 +827,20 @@ void Sniffer::on_connection_terminated(
 Sniffer::Sniffer(Tins::TCPIP::Stream &stream) : TCPSniffer(stream) {
 
     stream.client_data_callback(
-            [this](const Tins::TCPIP::Stream &tcp_stream) {
+            [this](Tins::TCPIP::Stream &tcp_stream) {
                 this->on_client_payload(tcp_stream);
+                if (abandoned_) {
+                    this->abandon_stream(tcp_stream);
+                }
             }
     );
 
     stream.server_data_callback(
-            [this](const Tins::TCPIP::Stream &tcp_stream) {
+            [this](Tins::TCPIP::Stream &tcp_stream) {
                 this->on_server_payload(tcp_stream);
+                if (abandoned_) {
+                    this->abandon_stream(tcp_stream);
+                }
             }
     );
 
@@ -458,11 +852,14 @@ Sniffer::Sniffer(Tins::TCPIP::Stream &stream) : TCPSniffer(stream) {
 
 }
 
-Sniffer::~Sniffer() {
+Sniffer::Sniffer(const std::string &id) : TCPSniffer(id) {
+}
 
+Sniffer::~Sniffer() {
+    release_pending();
 }
 
-std::string Sniffer::get_file_handle(const std::vector<uint8_t>& vec, uint64_t offset) {
+std::string Sniffer::get_file_handle(const uint8_t* vec, uint64_t offset) {
 
     std::ostringstream ostr;
     ostr << std::right << std::hex << std::setfill('0');
@@ -488,9 +885,9 @@ std::string Sniffer::get_file_handle(const std::vector<uint8_t>& vec, uint64_t o
     return ostr.str();
 }
 
-std::string Sniffer::get_file_name(const std::vector<uint8_t>& vec, uint64_t offset, uint64_t len) {
+std::string Sniffer::get_file_name(const uint8_t* vec, uint64_t offset, uint64_t len) {
     std::vector<wchar_t> tmp;
-    for (uint64_t i = offset; i < offset + len; i += 2) {
+    for (uint64_t i = offset; i + 1 < offset + len; i += 2) {
         tmp.push_back(vec[i] + (vec[i + 1] << 8));
     }
     std::wstring ws = std::wstring(tmp.begin(), tmp.end());
@@ -498,10 +895,10 @@ std::string Sniffer::get_file_name(const std::vector<uint8_t>& vec, uint64_t off
     return cov.to_bytes(ws);
 }
 
-uint64_t Sniffer::get_number(const std::vector<uint8_t>& vec, uint64_t offset, uint64_t len) {
+uint64_t Sniffer::get_number(const uint8_t* vec, uint64_t offset, uint64_t len) {
     uint64_t ret = 0, s = offset, t = offset + len;
     for (uint64_t i = s, carry = 0; i < t; ++i, carry += 8) {
-        ret += vec[i] << carry;
+        ret += static_cast<uint64_t>(vec[i]) << carry;
     }
     return ret;
 }
@@ -1,13 +1,18 @@
 #ifndef CUCKOOSNIFFER_SAMBA_SNIFFER_HPP
 #define CUCKOOSNIFFER_SAMBA_SNIFFER_HPP
 
+#include <set>
+#include <chrono>
+
 #include "base/sniffer.hpp"
+#include "util/extent_set.hpp"
 
 namespace cs {
 
 namespace util{
 
 class File;
+class Hasher;
 
 }
 
@@ -18,34 +23,108 @@ class Sniffer : public cs::base::TCPSniffer {
 public:
 
     virtual void on_client_payload(const Tins::TCPIP::Stream &);
-    std::vector<uint8_t> handle_client_NB_block(const std::vector<uint8_t>&);
-    void handle_client_req(const std::vector<uint8_t>&);
+    uint64_t handle_client_NB_block(const uint8_t*, uint64_t);
+    void handle_client_req(const uint8_t*, uint64_t);
 
     virtual void on_server_payload(const Tins::TCPIP::Stream &);
-    std::vector<uint8_t> handle_server_NB_block(const std::vector<uint8_t>&);
-    void handle_server_resp(const std::vector<uint8_t>&);
+    uint64_t handle_server_NB_block(const uint8_t*, uint64_t);
+    void handle_server_resp(const uint8_t*, uint64_t);
 
     virtual void on_connection_close(const Tins::TCPIP::Stream &);
 
+    virtual void on_tick(const std::chrono::steady_clock::time_point &);
+
     virtual void on_connection_terminated(
             Tins::TCPIP::Stream &,
             Tins::TCPIP::StreamFollower::TerminationReason);
 
     Sniffer(Tins::TCPIP::Stream &);
 
+    // not attached to a libtins stream, payload is fed through the NB block handlers
+    Sniffer(const std::string &);
+
     virtual ~Sniffer();
 
+    static void set_skip_signed_session(bool);
+
+    static void set_pipe_only_msg_limit(uint64_t);
+
+    static void set_idle_timeout(uint64_t);
+
+    static void set_emit_ratio(double);
+
 private:
 
-    std::string get_file_handle(const std::vector<uint8_t>&, uint64_t);
-    std::string get_file_name(const std::vector<uint8_t>&, uint64_t, uint64_t);
-    uint64_t get_number(const std::vector<uint8_t>&, uint64_t, uint64_t);
+    static bool skip_signed_session_;
+    static uint64_t pipe_only_msg_limit_;
+    static uint64_t idle_timeout_;
+    static double emit_ratio_;
+
+    // per open file, hash of the in-order prefix and what is buffered/emitted
+    struct FileState {
+        cs::util::Hasher* hasher;
+        uint64_t hashed_end;
+        bool in_order;
+        // results ahead of hashed_end, offset -> len, data owned by rw_result_map_
+        std::map<uint64_t, std::pair<uint64_t, const char*> > pending;
+        // bytes buffered for the next version and bytes of earlier versions
+        cs::util::ExtentSet buffered;
+        cs::util::ExtentSet emitted;
+        std::chrono::steady_clock::time_point last_io;
+        uint64_t version;
+        // its header showed content not worth collecting
+        bool skipped;
+        // everything emitted so far, later versions are merged over it
+        cs::util::File* content;
+    };
+
+    bool is_transform_header(const uint8_t*);
+    bool is_smb2_header(const uint8_t*);
+    void abandon(const char*);
+    void abandon_stream(Tins::TCPIP::Stream &);
+    void release_pending();
+
+    bool abandoned_ = false;
+
+    std::set<uint64_t> pipe_tree_id_;
+    bool disk_tree_connected_ = false;
+    uint64_t pipe_only_msg_ = 0;
+
+    uint64_t handle_NB_block(
+            const uint8_t*,
+            uint64_t,
+            uint64_t&,
+            std::vector<uint8_t>&,
+            void (Sniffer::*)(const uint8_t*, uint64_t));
+
+    void handle_client_msg(const uint8_t*, uint64_t, uint64_t);
+    void handle_server_msg(const uint8_t*, uint64_t);
 
-    void combine_data(const std::string&);
+    std::string resolve_file_id(uint64_t, const std::string&);
+
+    std::string get_file_handle(const uint8_t*, uint64_t);
+    std::string get_file_name(const uint8_t*, uint64_t, uint64_t);
+    uint64_t get_number(const uint8_t*, uint64_t, uint64_t);
+
+    void combine_data(const std::string&, bool);
+
+    void add_result(const std::string&, uint64_t, uint64_t, char*);
+    FileState& get_file_state(const std::string&);
+    void reset_hash(FileState&);
+    void update_hash(FileState&, uint64_t, uint64_t, const char*);
+    void erase_file_state(const std::string&);
 
     std::map<uint64_t, std::string> create_req_file_name_;
     std::map<uint64_t, std::string> close_msg_;
 
+    // msg id of a related compound operation -> msg id of the CREATE it follows
+    std::map<uint64_t, uint64_t> related_req_map_;
+    // msg id of a CREATE referenced by related operations -> its file id
+    std::map<uint64_t, std::string> related_file_id_;
+
+    // async id from a STATUS_PENDING interim response -> msg id
+    std::map<uint64_t, uint64_t> async_msg_map_;
+
     std::map<std::string, std::pair<std::string, uint64_t> > file_info_;
 
     std::map<uint64_t, std::tuple<std::string, uint64_t, uint64_t> > read_req_map_;
@@ -54,12 +133,17 @@ private:
 
     std::multimap<std::string, std::tuple<uint64_t, uint64_t, char*> > rw_result_map_;
 
+    std::map<std::string, FileState> file_state_;
+
     uint64_t server_NB_block_remain_ = 0;
     std::vector<uint8_t> server_NB_block_;
     uint64_t client_NB_block_remain_ = 0;
     std::vector<uint8_t> client_NB_block_;
 
     enum COMMAND {
+        NEGOTIATE=0,
+        SESSION_SETUP=1,
+        TREE_CONNECT=3,
         CREATE=5,
         CLOSE=6,
         READ=8,
@@ -67,6 +151,28 @@ private:
 
     };
 
+    enum FLAGS {
+        SERVER_TO_REDIR=0x00000001,
+        ASYNC_COMMAND=0x00000002,
+        RELATED_OPERATIONS=0x00000004,
+        SIGNED=0x00000008,
+        DFS_OPERATIONS=0x10000000
+    };
+
+    enum STATUS {
+        STATUS_SUCCESS=0x00000000,
+        STATUS_PENDING=0x00000103
+    };
+
+    static const uint64_t NB_HEADER_SIZE = 4;
+    static const uint64_t SMB2_HEADER_SIZE = 64;
+
+    enum SHARE_TYPE {
+        SHARE_TYPE_DISK=0x01,
+        SHARE_TYPE_PIPE=0x02,
+        SHARE_TYPE_PRINT=0x03
+    };
+
 };
 
 }
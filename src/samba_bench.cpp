@@ -0,0 +1,456 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <atomic>
+#include <new>
+
+#include <boost/log/core.hpp>
+
+#include "cuckoo_sniffer.hpp"
+#include "samba/sniffer.hpp"
+#include "samba/collected_data.hpp"
+#include "util/file.hpp"
+#include "util/hash.hpp"
+
+// Synthetic SMB2 traffic fed straight into samba::Sniffer, no libtins involved.
+//
+// usage: SambaBench [file_size] [io_size] [files] [interleave] [segment_size] [compound]
+//
+// Half of the files are read by the client, the other half written. Up to
+// `interleave` files are open at the same time and their I/O is issued round
+// robin. Both directions are cut into `segment_size` byte segments regardless
+// of message boundaries. With `compound` set, CREATE is compounded with the
+// first READ/WRITE (and the CLOSE for single-I/O files) as related operations.
+
+static std::atomic<uint64_t> alloc_count(0);
+
+void* operator new(size_t size) {
+    ++alloc_count;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+namespace {
+
+typedef std::vector<uint8_t> Buffer;
+
+enum Command {
+    CREATE = 5,
+    CLOSE = 6,
+    READ = 8,
+    WRITE = 9
+};
+
+const uint32_t FLAGS_RESPONSE = 0x1;
+const uint32_t FLAGS_RELATED = 0x4;
+
+void put_number(Buffer& buf, size_t offset, uint64_t value, size_t len) {
+    if (buf.size() < offset + len) {
+        buf.resize(offset + len);
+    }
+    for (size_t i = 0; i < len; ++i) {
+        buf[offset + i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+void put_file_id(Buffer& buf, size_t offset, const uint8_t* file_id) {
+    if (buf.size() < offset + 16) {
+        buf.resize(offset + 16);
+    }
+    memcpy(buf.data() + offset, file_id, 16);
+}
+
+Buffer smb2_header(uint16_t command, uint64_t msg_id, uint32_t flags) {
+    Buffer buf(64, 0);
+    buf[0] = 0xFE;
+    buf[1] = 'S';
+    buf[2] = 'M';
+    buf[3] = 'B';
+    put_number(buf, 4, 64, 2);
+    put_number(buf, 12, command, 2);
+    put_number(buf, 16, flags, 4);
+    put_number(buf, 24, msg_id, 8);
+    return buf;
+}
+
+Buffer create_req(uint64_t msg_id, const std::string& name, uint32_t flags) {
+    Buffer buf = smb2_header(CREATE, msg_id, flags);
+    put_number(buf, 64, 57, 2);
+    put_number(buf, 64 + 24, 1, 4);       //FILE_READ_DATA
+    put_number(buf, 64 + 28, 0x80, 4);    //FILE_ATTRIBUTE_NORMAL
+    put_number(buf, 64 + 44, 64 + 56, 2);
+    put_number(buf, 64 + 46, name.size() * 2, 2);
+    buf.resize(64 + 56);
+    for (char c: name) {
+        buf.push_back(static_cast<uint8_t>(c));
+        buf.push_back(0);
+    }
+    return buf;
+}
+
+Buffer create_resp(uint64_t msg_id, const uint8_t* file_id, uint64_t file_eof, uint32_t flags) {
+    Buffer buf = smb2_header(CREATE, msg_id, flags | FLAGS_RESPONSE);
+    put_number(buf, 64, 89, 2);
+    put_number(buf, 64 + 48, file_eof, 8);
+    put_number(buf, 64 + 56, 0x80, 4);
+    put_file_id(buf, 64 + 64, file_id);
+    return buf;
+}
+
+Buffer read_req(uint64_t msg_id, const uint8_t* file_id, uint64_t len, uint64_t offset, uint32_t flags) {
+    Buffer buf = smb2_header(READ, msg_id, flags);
+    put_number(buf, 64, 49, 2);
+    put_number(buf, 64 + 4, len, 4);
+    put_number(buf, 64 + 8, offset, 8);
+    put_file_id(buf, 64 + 16, file_id);
+    buf.resize(64 + 49);
+    return buf;
+}
+
+Buffer read_resp(uint64_t msg_id, const char* data, uint64_t len, uint32_t flags) {
+    Buffer buf = smb2_header(READ, msg_id, flags | FLAGS_RESPONSE);
+    put_number(buf, 64, 17, 2);
+    put_number(buf, 64 + 2, 80, 1);
+    put_number(buf, 64 + 4, len, 4);
+    buf.resize(80);
+    buf.insert(buf.end(), data, data + len);
+    return buf;
+}
+
+Buffer write_req(uint64_t msg_id, const uint8_t* file_id, const char* data, uint64_t len, uint64_t offset,
+                 uint32_t flags) {
+    Buffer buf = smb2_header(WRITE, msg_id, flags);
+    put_number(buf, 64, 49, 2);
+    put_number(buf, 64 + 2, 112, 2);
+    put_number(buf, 64 + 4, len, 4);
+    put_number(buf, 64 + 8, offset, 8);
+    put_file_id(buf, 64 + 16, file_id);
+    buf.resize(112);
+    buf.insert(buf.end(), data, data + len);
+    return buf;
+}
+
+Buffer write_resp(uint64_t msg_id, uint64_t len, uint32_t flags) {
+    Buffer buf = smb2_header(WRITE, msg_id, flags | FLAGS_RESPONSE);
+    put_number(buf, 64, 17, 2);
+    put_number(buf, 64 + 4, len, 4);
+    buf.resize(80);
+    return buf;
+}
+
+Buffer close_req(uint64_t msg_id, const uint8_t* file_id, uint32_t flags) {
+    Buffer buf = smb2_header(CLOSE, msg_id, flags);
+    put_number(buf, 64, 24, 2);
+    put_file_id(buf, 64 + 8, file_id);
+    return buf;
+}
+
+Buffer close_resp(uint64_t msg_id, uint32_t flags) {
+    Buffer buf = smb2_header(CLOSE, msg_id, flags | FLAGS_RESPONSE);
+    put_number(buf, 64, 60, 2);
+    buf.resize(64 + 60);
+    return buf;
+}
+
+// NextCommand chaining, every message but the last is padded to 8 bytes
+Buffer compound(std::vector<Buffer> msgs) {
+    Buffer out;
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        Buffer& msg = msgs[i];
+        if (i + 1 < msgs.size()) {
+            while (msg.size() % 8 != 0) {
+                msg.push_back(0);
+            }
+            put_number(msg, 20, msg.size(), 4);
+        }
+        out.insert(out.end(), msg.begin(), msg.end());
+    }
+    return out;
+}
+
+void append_NB_block(Buffer& out, const Buffer& msg) {
+    out.push_back(0);
+    out.push_back(static_cast<uint8_t>(msg.size() >> 16));
+    out.push_back(static_cast<uint8_t>(msg.size() >> 8));
+    out.push_back(static_cast<uint8_t>(msg.size()));
+    out.insert(out.end(), msg.begin(), msg.end());
+}
+
+struct Segment {
+    bool from_client;
+    Buffer data;
+};
+
+struct GeneratedFile {
+    std::string name;
+    std::string content;
+    uint8_t file_id[16];
+    bool write;
+    uint64_t next_offset;
+    bool opened;
+};
+
+class TrafficGenerator {
+
+public:
+
+    TrafficGenerator(uint64_t segment_size) : segment_size_(segment_size), msg_id_(1), op_count_(0) {}
+
+    void client(const Buffer& msg) {
+        append(true, msg);
+    }
+
+    void server(const Buffer& msg) {
+        append(false, msg);
+    }
+
+    uint64_t next_msg_id() {
+        ++op_count_;
+        return msg_id_++;
+    }
+
+    std::vector<Segment> finish() {
+        flush();
+        return std::move(segments_);
+    }
+
+    uint64_t get_op_count() const {
+        return op_count_;
+    }
+
+private:
+
+    void append(bool from_client, const Buffer& msg) {
+        if (from_client != pending_from_client_ && !pending_.empty()) {
+            flush();
+        }
+        pending_from_client_ = from_client;
+        append_NB_block(pending_, msg);
+        uint64_t start = 0;
+        while (pending_.size() - start >= segment_size_) {
+            Segment segment;
+            segment.from_client = from_client;
+            segment.data.assign(pending_.begin() + start, pending_.begin() + start + segment_size_);
+            segments_.push_back(std::move(segment));
+            start += segment_size_;
+        }
+        pending_.erase(pending_.begin(), pending_.begin() + start);
+    }
+
+    void flush() {
+        if (!pending_.empty()) {
+            Segment segment;
+            segment.from_client = pending_from_client_;
+            segment.data.swap(pending_);
+            segments_.push_back(std::move(segment));
+        }
+    }
+
+    uint64_t segment_size_;
+    uint64_t msg_id_;
+    uint64_t op_count_;
+    bool pending_from_client_ = true;
+    Buffer pending_;
+    std::vector<Segment> segments_;
+
+};
+
+// one CREATE/READ|WRITE/CLOSE step of a file, returns false once the file is closed
+bool generate_step(TrafficGenerator& gen, GeneratedFile& file, uint64_t io_size, bool use_compound) {
+    static const uint8_t related_id[16] = {
+            0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+            0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+    };
+    uint64_t size = file.content.size();
+
+    if (!file.opened) {
+        file.opened = true;
+        uint64_t create_id = gen.next_msg_id();
+        if (!use_compound) {
+            gen.client(create_req(create_id, file.name, 0));
+            gen.server(create_resp(create_id, file.file_id, file.write ? 0 : size, 0));
+            return true;
+        }
+
+        //CREATE + first I/O (+ CLOSE when it is the only one) as related operations
+        uint64_t len = std::min(io_size, size);
+        uint64_t io_id = gen.next_msg_id();
+        bool last = len == size;
+        std::vector<Buffer> reqs, resps;
+        reqs.push_back(create_req(create_id, file.name, 0));
+        resps.push_back(create_resp(create_id, file.file_id, file.write ? 0 : size, 0));
+        if (file.write) {
+            reqs.push_back(write_req(io_id, related_id, file.content.data(), len, 0, FLAGS_RELATED));
+            resps.push_back(write_resp(io_id, len, FLAGS_RELATED));
+        }
+        else {
+            reqs.push_back(read_req(io_id, related_id, len, 0, FLAGS_RELATED));
+            resps.push_back(read_resp(io_id, file.content.data(), len, FLAGS_RELATED));
+        }
+        if (last) {
+            uint64_t close_id = gen.next_msg_id();
+            reqs.push_back(close_req(close_id, related_id, FLAGS_RELATED));
+            resps.push_back(close_resp(close_id, FLAGS_RELATED));
+        }
+        gen.client(compound(reqs));
+        gen.server(compound(resps));
+        file.next_offset = len;
+        return !last;
+    }
+
+    if (file.next_offset < size) {
+        uint64_t len = std::min(io_size, size - file.next_offset);
+        uint64_t io_id = gen.next_msg_id();
+        const char* data = file.content.data() + file.next_offset;
+        if (file.write) {
+            gen.client(write_req(io_id, file.file_id, data, len, file.next_offset, 0));
+            gen.server(write_resp(io_id, len, 0));
+        }
+        else {
+            gen.client(read_req(io_id, file.file_id, len, file.next_offset, 0));
+            gen.server(read_resp(io_id, data, len, 0));
+        }
+        file.next_offset += len;
+        return true;
+    }
+
+    uint64_t close_id = gen.next_msg_id();
+    gen.client(close_req(close_id, file.file_id, 0));
+    gen.server(close_resp(close_id, 0));
+    return false;
+}
+
+}
+
+int main(int argc, const char* argv[]) {
+
+    uint64_t file_size = argc > 1 ? std::stoull(argv[1]) : 1024 * 1024;
+    uint64_t io_size = argc > 2 ? std::stoull(argv[2]) : 64 * 1024;
+    uint64_t file_num = argc > 3 ? std::stoull(argv[3]) : 64;
+    uint64_t interleave = argc > 4 ? std::stoull(argv[4]) : 4;
+    uint64_t segment_size = argc > 5 ? std::stoull(argv[5]) : 1460;
+    bool use_compound = argc > 6 ? std::stoi(argv[6]) != 0 : true;
+
+    if (file_size == 0 || io_size == 0 || file_num == 0 || interleave == 0 || segment_size == 0) {
+        std::cerr << "sizes and counts must be positive" << std::endl;
+        return 1;
+    }
+
+    boost::log::core::get()->set_logging_enabled(false);
+
+    std::vector<GeneratedFile> files(file_num);
+    for (uint64_t i = 0; i < file_num; ++i) {
+        GeneratedFile& file = files[i];
+        file.name = "bench_" + std::to_string(i) + ".bin";
+        file.content.resize(file_size);
+        uint32_t seed = static_cast<uint32_t>(i * 2654435761u + 1);
+        for (uint64_t j = 0; j < file_size; ++j) {
+            seed = seed * 1103515245u + 12345u;
+            file.content[j] = static_cast<char>(seed >> 16);
+        }
+        for (int j = 0; j < 16; ++j) {
+            file.file_id[j] = static_cast<uint8_t>((i >> (8 * (j % 8))) + j);
+        }
+        file.write = i % 2 == 1;
+        file.next_offset = 0;
+        file.opened = false;
+    }
+
+    TrafficGenerator gen(segment_size);
+    std::vector<uint64_t> open_files;
+    uint64_t next_file = 0;
+    while (next_file < file_num || !open_files.empty()) {
+        while (open_files.size() < interleave && next_file < file_num) {
+            open_files.push_back(next_file++);
+        }
+        for (auto iter = open_files.begin(); iter != open_files.end();) {
+            if (generate_step(gen, files[*iter], io_size, use_compound)) {
+                ++iter;
+            }
+            else {
+                iter = open_files.erase(iter);
+            }
+        }
+    }
+    uint64_t op_count = gen.get_op_count();
+    std::vector<Segment> segments = gen.finish();
+
+    uint64_t wire_bytes = 0;
+    for (const auto& segment: segments) {
+        wire_bytes += segment.data.size();
+    }
+
+    cs::samba::Sniffer sniffer("samba-bench");
+
+    uint64_t alloc_before = alloc_count.load();
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& segment: segments) {
+        const uint8_t* data = segment.data.data();
+        uint64_t len = segment.data.size();
+        while (len > 0) {
+            uint64_t consumed = segment.from_client ?
+                                sniffer.handle_client_NB_block(data, len) :
+                                sniffer.handle_server_NB_block(data, len);
+            data += consumed;
+            len -= consumed;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    uint64_t alloc_after = alloc_count.load();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double payload_mb = static_cast<double>(file_size) * file_num / (1024 * 1024);
+    double wire_mb = static_cast<double>(wire_bytes) / (1024 * 1024);
+
+    std::cout << "files " << file_num << ", file size " << file_size << ", io size " << io_size
+              << ", interleave " << interleave << ", segment " << segment_size
+              << ", compound " << use_compound << std::endl;
+    std::cout << "segments " << segments.size() << ", operations " << op_count << std::endl;
+    std::cout << "time " << seconds * 1000 << " ms" << std::endl;
+    std::cout << "payload " << payload_mb / seconds << " MB/s, wire " << wire_mb / seconds << " MB/s" << std::endl;
+    std::cout << "allocations per operation "
+              << static_cast<double>(alloc_after - alloc_before) / op_count << std::endl;
+
+    //every file is emitted at CLOSE, check it against what was generated
+    int failed = 0;
+    uint64_t emitted = 0;
+    while (cs::base::CollectedData* data = cs::DATA_QUEUE.try_dequeue()) {
+        ++emitted;
+        auto* collected = dynamic_cast<cs::samba::CollectedData*>(data);
+        cs::util::File* file = collected -> get_data();
+        const std::string& name = file -> get_name();
+        uint64_t index = std::stoull(name.substr(6, name.find('.') - 6));
+        const std::string& content = files[index].content;
+        if (file -> get_size() != content.size() ||
+            memcmp(file -> get_buffer(), content.data(), content.size()) != 0) {
+            std::cerr << "content mismatch " << name << std::endl;
+            ++failed;
+        }
+        else if (file -> get_digest().sha256 != cs::util::hash(content.data(), content.size()).sha256) {
+            std::cerr << "digest mismatch " << name << std::endl;
+            ++failed;
+        }
+        delete collected;
+    }
+    if (emitted != file_num) {
+        std::cerr << "emitted " << emitted << " of " << file_num << " files" << std::endl;
+        ++failed;
+    }
+    std::cout << (failed == 0 ? "content verified" : "content verification FAILED") << std::endl;
+
+    return failed == 0 ? 0 : 1;
+}
@@ -4,14 +4,20 @@ namespace cs {
 namespace smtp {
 
 CollectedData::CollectedData(
+        const Envelope &envelope,
         std::string &&data) :
         cs::base::CollectedData(DataType::SMTP) {
+    envelope_ = envelope;
     data_ = std::move(data);
 }
 
+const Envelope &CollectedData::get_envelope() const {
+    return envelope_;
+}
+
 const std::string &CollectedData::get_data() const {
     return data_;
 }
 
 }
-}
\ No newline at end of file
+}
@@ -3,21 +3,33 @@
 
 
 #include <string>
+#include <vector>
 #include "base/collected_data.hpp"
 
 namespace cs {
 namespace smtp {
 
+struct Envelope {
+    std::string helo;
+    std::string auth;
+    std::string mail_from;
+    std::vector<std::string> rcpt_to;
+};
+
 class CollectedData: public cs::base::CollectedData {
 
 public:
 
-    CollectedData(std::string&&);
+    CollectedData(const Envelope&, std::string&&);
+
+    const Envelope& get_envelope() const;
 
     const std::string& get_data() const;
 
 private:
 
+    Envelope envelope_;
+
     std::string data_;
 
 };
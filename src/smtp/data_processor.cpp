@@ -1,5 +1,6 @@
 #include "smtp/data_processor.hpp"
 
+#include "cuckoo_sniffer.hpp"
 #include "smtp/collected_data.hpp"
 #include "util/base64.hpp"
 #include "util/file.hpp"
@@ -11,7 +12,20 @@ namespace smtp {
 int DataProcessor::process(cs::base::CollectedData* collected_data_arg) {
 
     CollectedData &sniffer_data = *dynamic_cast<CollectedData*>(collected_data_arg);
-    util::mail_process(sniffer_data.get_data());
+    const Envelope& envelope = sniffer_data.get_envelope();
+
+    LOG_INFO << "SMTP helo " << envelope.helo;
+    if (!envelope.auth.empty())
+        LOG_INFO << "SMTP auth " << envelope.auth;
+    LOG_INFO << "SMTP mail from " << envelope.mail_from;
+    for (const auto& rcpt: envelope.rcpt_to) {
+        LOG_INFO << "SMTP rcpt to " << rcpt;
+    }
+    LOG_INFO << "SMTP message size " << sniffer_data.get_data().size();
+
+    for (util::File* file: util::mail_process(sniffer_data.get_data())) {
+        delete file;
+    }
 
     return 1;
 
@@ -21,4 +35,4 @@ int DataProcessor::process(cs::base::CollectedData* collected_data_arg) {
 DataProcessor::~DataProcessor() {}
 
 }
-}
\ No newline at end of file
+}
@@ -1,34 +1,162 @@
 #include "smtp/sniffer.hpp"
 
+#include <cstring>
+
 #include "cuckoo_sniffer.hpp"
 #include "sniffer_manager.hpp"
 #include "smtp/collected_data.hpp"
 #include "smtp/data_processor.hpp"
+#include "util/statistics.hpp"
 
 namespace cs {
 namespace smtp {
 
+namespace {
+
+enum Verb {
+    VERB_HELO,
+    VERB_EHLO,
+    VERB_AUTH,
+    VERB_MAIL,
+    VERB_RCPT,
+    VERB_DATA,
+    VERB_BDAT,
+    VERB_RSET,
+    VERB_STARTTLS,
+    VERB_QUIT,
+    VERB_NUM
+};
+
+const char* const VERBS[VERB_NUM] = {
+    "HELO",
+    "EHLO",
+    "AUTH",
+    "MAIL",
+    "RCPT",
+    "DATA",
+    "BDAT",
+    "RSET",
+    "STARTTLS",
+    "QUIT"
+};
+
+//the address of "FROM:<a>" or "TO:<a>", parameters after it are dropped
+std::string get_path(cs::util::StringView argument, const char* prefix) {
+    if (!argument.starts_with_nocase(prefix))
+        return "";
+    argument = argument.substr(strlen(prefix));
+    while (!argument.empty() && argument.data[0] == ' ')
+        argument = argument.substr(1);
+    return cs::util::next_token(argument).to_string();
+}
+
+}
+
 void Sniffer::on_client_payload(const Tins::TCPIP::Stream &stream) {
-    LOG_TRACE << "SMTP data size :" << stream.client_payload().size();
+    if (abandoned_)
+        return;
+
+    const Tins::TCPIP::Stream::payload_type& payload = stream.client_payload();
+    const char* data = reinterpret_cast<const char*>(payload.data());
+    uint64_t len = payload.size();
+
+    uint64_t pos = 0;
+    while (pos < len && !abandoned_) {
+        switch (state_) {
+            case DATA_PENDING:
+                pos += feed_data_pending(data + pos, len - pos);
+                break;
+            case DATA:
+                pos += feed_data(data + pos, len - pos);
+                break;
+            case BDAT:
+                pos += feed_bdat(data + pos, len - pos);
+                break;
+            case QUIT:
+                return;
+            case STARTTLS:
+                //a handshake record means the server said yes
+                if (data[pos] == 0x16) {
+                    tls_upgraded();
+                    return;
+                }
+                state_ = COMMAND;
+                pos += feed_command(data + pos, len - pos);
+                break;
+            default:
+                pos += feed_command(data + pos, len - pos);
+        }
+    }
 }
 
 void Sniffer::on_server_payload(const Tins::TCPIP::Stream &stream) {
+    if (abandoned_)
+        return;
+
+    const Tins::TCPIP::Stream::payload_type& payload = stream.server_payload();
+    const char* data = reinterpret_cast<const char*>(payload.data());
+    uint64_t len = payload.size();
+
+    cs::util::StringView line;
+    while (!abandoned_ && reply_buffer_.next(data, len, line))
+        handle_reply(line);
 }
 
-void Sniffer::on_connection_close(const Tins::TCPIP::Stream &stream) {
-    LOG_TRACE << "SMTP data size :" << stream.client_payload().size();
-    LOG_DEBUG << id_ << " " << "SMTP Connection Close" << std::endl;
+void Sniffer::handle_reply(cs::util::StringView line) {
+    //only the last line of a multiline reply answers the command
+    if (line.size < 3 || (line.size > 3 && line.data[3] != ' '))
+        return;
+    //the greeting, or replies to commands sent before the capture started
+    if (replies_.empty())
+        return;
 
-    //TODO make this process in thread
-    CollectedData *smtp_data = new CollectedData(
-            std::string(stream.client_payload().begin(), stream.client_payload().end())
-    );
+    Reply reply = replies_.front();
+    replies_.pop_front();
+    bool refused = line.data[0] == '4' || line.data[0] == '5';
 
-    cs::smtp::DataProcessor processor;
-    processor.process((CollectedData *) smtp_data);
+    switch (reply) {
+        case REPLY_STARTTLS:
+            if (line.starts_with_nocase("220"))
+                tls_upgraded();
+            else if (refused && state_ == STARTTLS)
+                state_ = COMMAND;
+            break;
+        case REPLY_DATA:
+            if (state_ != DATA_PENDING)
+                break;
+            if (line.starts_with_nocase("354")) {
+                enter_data();
+            }
+            else if (refused) {
+                LOG_DEBUG << id_ << " SMTP DATA refused: " << line.to_string();
+                state_ = COMMAND;
+                reset_message();
+            }
+            break;
+        case REPLY_BDAT_LAST:
+            held_message_complete(!refused);
+            break;
+        default:
+            break;
+    }
+}
 
+void Sniffer::expect_reply(Reply reply) {
+    //replies that never came are forgotten
+    if (replies_.size() >= MAX_PENDING_REPLIES)
+        replies_.pop_front();
+    replies_.push_back(reply);
+}
+
+void Sniffer::on_connection_close(const Tins::TCPIP::Stream &stream) {
+    LOG_DEBUG << id_ << " " << "SMTP Connection Close";
+
+    held_message_complete(true);
+    if (message_open_ && !message_.empty()) {
+        LOG_DEBUG << id_ << " SMTP message truncated by connection close.";
+        message_complete();
+    }
 
-    delete smtp_data;
     cs::SNIFFER_MANAGER.erase_sniffer(id_);
 }
 
@@ -39,13 +167,265 @@ void Sniffer::on_connection_terminated(
     cs::SNIFFER_MANAGER.erase_sniffer(id_);
 }
 
-Sniffer::Sniffer(Tins::TCPIP::Stream &stream) : TCPSniffer(stream) {
+//the client waits for 354 before the content, a command in its place means
+//DATA was refused, anything else is content whose 354 was not seen
+uint64_t Sniffer::feed_data_pending(const char* data, uint64_t len) {
+    const char* end = static_cast<const char*>(memchr(data, '\n', len));
+    uint64_t used = end == nullptr ? len : end - data + 1;
+    line_.append(data, used);
+    if (end == nullptr && line_.size() < MAX_COMMAND_SIZE)
+        return used;
+
+    cs::util::StringView line(line_);
+    while (!line.empty() && (line.data[line.size - 1] == '\n' || line.data[line.size - 1] == '\r'))
+        --line.size;
+    cs::util::Command command = cs::util::parse_command(line);
+    if (end != nullptr && cs::util::lookup_verb(command.verb, VERBS, VERB_NUM) != VERB_NUM) {
+        LOG_DEBUG << id_ << " SMTP DATA not answered with 354, back to commands.";
+        std::string command_line;
+        command_line.swap(line_);
+        state_ = COMMAND;
+        reset_message();
+        handle_command(cs::util::StringView(command_line).substr(0, line.size));
+        return used;
+    }
+    enter_data();
+    return used;
+}
+
+//content held back while DATA was unanswered is fed once it is known to be content
+void Sniffer::enter_data() {
+    std::string held;
+    held.swap(line_);
+    state_ = DATA;
+    uint64_t pos = 0;
+    while (pos < held.size() && state_ == DATA)
+        pos += feed_data(held.data() + pos, held.size() - pos);
+}
+
+uint64_t Sniffer::feed_command(const char* data, uint64_t len) {
+    //one line at most, the state may change after it
+    uint64_t remain = len;
+    cs::util::StringView line;
+    bool complete = command_buffer_.next(data, remain, line);
+    if (command_buffer_.has_overflowed()) {
+        LOG_DEBUG << id_ << " SMTP command too long, abandon connection.";
+        abandoned_ = true;
+    }
+    else if (complete) {
+        handle_command(line);
+    }
+    return len - remain;
+}
+
+void Sniffer::handle_command(cs::util::StringView line) {
+    cs::util::Command command = cs::util::parse_command(line);
+    int verb = cs::util::lookup_verb(command.verb, VERBS, VERB_NUM);
+
+    //sasl responses follow AUTH until the client moves on to a command
+    if (state_ == AUTH) {
+        if (verb != VERB_EHLO && verb != VERB_HELO && verb != VERB_MAIL &&
+                verb != VERB_RSET && verb != VERB_QUIT && verb != VERB_AUTH) {
+            if (!line.equals_nocase("*"))
+                envelope_.auth += " " + line.to_string();
+            expect_reply(REPLY_OTHER);
+            return;
+        }
+        state_ = COMMAND;
+    }
+    Reply reply = REPLY_OTHER;
+
+    LOG_TRACE << id_ << " SMTP command " << line.substr(0, 64).to_string();
+
+    switch (verb) {
+        case VERB_HELO:
+        case VERB_EHLO:
+            envelope_ = Envelope();
+            envelope_.helo = cs::util::next_token(command.argument).to_string();
+            reset_message();
+            break;
+        case VERB_AUTH:
+            envelope_.auth = command.argument.to_string();
+            state_ = AUTH;
+            break;
+        case VERB_MAIL:
+            envelope_.mail_from = get_path(command.argument, "FROM:");
+            envelope_.rcpt_to.clear();
+            reset_message();
+            break;
+        case VERB_RCPT:
+            envelope_.rcpt_to.push_back(get_path(command.argument, "TO:"));
+            break;
+        case VERB_DATA:
+            reset_message();
+            message_open_ = true;
+            at_line_start_ = true;
+            state_ = DATA_PENDING;
+            reply = REPLY_DATA;
+            break;
+        case VERB_BDAT: {
+            cs::util::parse_uint(cs::util::next_token(command.argument), bdat_remain_);
+            bdat_last_ = cs::util::next_token(command.argument).equals_nocase("LAST");
+            message_open_ = true;
+            state_ = BDAT;
+            if (bdat_last_)
+                reply = REPLY_BDAT_LAST;
+            expect_reply(reply);
+            if (bdat_remain_ == 0)
+                feed_bdat(nullptr, 0);
+            return;
+        }
+        case VERB_RSET:
+            envelope_.mail_from.clear();
+            envelope_.rcpt_to.clear();
+            reset_message();
+            break;
+        case VERB_STARTTLS:
+            state_ = STARTTLS;
+            reply = REPLY_STARTTLS;
+            break;
+        case VERB_QUIT:
+            state_ = QUIT;
+            break;
+        default:
+            break;
+    }
+    expect_reply(reply);
+}
+
+uint64_t Sniffer::feed_data(const char* data, uint64_t len) {
+    //lines starting with a dot are the terminator or dot-stuffed
+    if (at_line_start_ && (!line_.empty() || data[0] == '.')) {
+        const char* end = static_cast<const char*>(memchr(data, '\n', len));
+        uint64_t used = end == nullptr ? len : end - data + 1;
+        line_.append(data, used);
+
+        if (line_ == ".\r\n" || line_ == ".\n") {
+            line_.clear();
+            message_complete();
+            state_ = COMMAND;
+            expect_reply(REPLY_OTHER);
+            return used;
+        }
+        if (end == nullptr && (line_ == "." || line_ == ".\r")) {
+            return used;
+        }
+
+        append_message(line_.data() + 1, line_.size() - 1);
+        at_line_start_ = end != nullptr;
+        line_.clear();
+        return used;
+    }
+
+    const char* end = static_cast<const char*>(memchr(data, '\n', len));
+    uint64_t used = end == nullptr ? len : end - data + 1;
+    append_message(data, used);
+    at_line_start_ = end != nullptr;
+    return used;
+}
+
+uint64_t Sniffer::feed_bdat(const char* data, uint64_t len) {
+    uint64_t used = len < bdat_remain_ ? len : bdat_remain_;
+    append_message(data, used);
+    bdat_remain_ -= used;
+    if (bdat_remain_ == 0) {
+        //kept until the server takes it, the next message may already follow
+        if (bdat_last_) {
+            held_message_complete(true);
+            LOG_DEBUG << id_ << " SMTP message from " << envelope_.mail_from
+                      << " size: " << message_.size();
+            held_message_ = new CollectedData(envelope_, std::move(message_));
+            reset_message();
+        }
+        state_ = COMMAND;
+    }
+    return used;
+}
+
+void Sniffer::append_message(const char* data, uint64_t len) {
+    if (message_.size() + len > MAX_MESSAGE_SIZE) {
+        if (message_.size() < MAX_MESSAGE_SIZE)
+            LOG_DEBUG << id_ << " SMTP message over " << MAX_MESSAGE_SIZE << " bytes, truncated.";
+        len = MAX_MESSAGE_SIZE - message_.size();
+    }
+    message_.append(data, len);
+}
+
+void Sniffer::message_complete() {
+    LOG_DEBUG << id_ << " SMTP message from " << envelope_.mail_from
+              << " size: " << message_.size();
+
+    CollectedData *smtp_data = new CollectedData(envelope_, std::move(message_));
+    cs::DATA_QUEUE.enqueue(smtp_data);
+    reset_message();
+}
 
+//a message sent with BDAT LAST goes out once the server took it
+void Sniffer::held_message_complete(bool accepted) {
+    if (held_message_ == nullptr)
+        return;
+    if (accepted) {
+        cs::DATA_QUEUE.enqueue(held_message_);
+    }
+    else {
+        LOG_DEBUG << id_ << " SMTP BDAT message refused, dropped.";
+        delete held_message_;
+    }
+    held_message_ = nullptr;
+}
+
+void Sniffer::reset_message() {
+    //a moved-from or cleared buffer may still hold the last message's capacity
+    std::string().swap(message_);
+    message_open_ = false;
+}
+
+void Sniffer::tls_upgraded() {
+    LOG_DEBUG << id_ << " SMTP STARTTLS, abandon connection.";
+    cs::util::STATISTICS.increase(cs::util::Statistics::SMTP_STARTTLS);
+
+    abandoned_ = true;
+    held_message_complete(true);
+    reset_message();
+    std::string().swap(line_);
+    command_buffer_.clear();
+}
+
+void Sniffer::abandon_stream(Tins::TCPIP::Stream& stream) {
+    stream.ignore_client_data();
     stream.ignore_server_data();
-    stream.auto_cleanup_client_data(false);
+}
+
+Sniffer::Sniffer(Tins::TCPIP::Stream &stream) :
+        TCPSniffer(stream),
+        state_(COMMAND),
+        command_buffer_(MAX_COMMAND_SIZE),
+        reply_buffer_(MAX_COMMAND_SIZE),
+        at_line_start_(true),
+        bdat_remain_(0),
+        bdat_last_(false),
+        message_open_(false),
+        held_message_(nullptr),
+        abandoned_(false) {
+
+    stream.auto_cleanup_client_data(true);
+    stream.auto_cleanup_server_data(true);
     stream.client_data_callback(
-            [this](const Tins::TCPIP::Stream& tcp_stream) {
+            [this](Tins::TCPIP::Stream& tcp_stream) {
                 this -> on_client_payload(tcp_stream);
+                if (abandoned_) {
+                    this -> abandon_stream(tcp_stream);
+                }
+            }
+    );
+
+    //replies tell whether DATA, BDAT and STARTTLS were taken
+    stream.server_data_callback(
+            [this](Tins::TCPIP::Stream& tcp_stream) {
+                this -> on_server_payload(tcp_stream);
+                if (abandoned_) {
+                    this -> abandon_stream(tcp_stream);
+                }
             }
     );
 
@@ -58,7 +438,7 @@ Sniffer::Sniffer(Tins::TCPIP::Stream &stream) : TCPSniffer(stream) {
 }
 
 Sniffer::~Sniffer() {
-    cs::SNIFFER_MANAGER.erase_sniffer(id_);
+    delete held_message_;
 }
 
 }
@@ -1,11 +1,20 @@
 #ifndef CUCKOOSNIFFER_SMTP_SNIFFER_HPP
 #define CUCKOOSNIFFER_SMTP_SNIFFER_HPP
 
+#include <deque>
+
 #include "base/sniffer.hpp"
+#include "smtp/collected_data.hpp"
+#include "util/line_buffer.hpp"
 
 namespace cs {
 namespace smtp {
 
+// Follows the client side of an SMTP session command by command. Message
+// content is unstuffed into a per-message buffer and every finished
+// message goes to the worker queue, nothing is kept by libtins. Server
+// replies are matched to the commands they answer, so refused DATA, BDAT
+// and STARTTLS commands leave the session in command mode.
 class Sniffer : public cs::base::TCPSniffer {
 
 public:
@@ -24,8 +33,88 @@ public:
 
     virtual ~Sniffer();
 
+    static const uint64_t MAX_COMMAND_SIZE = 4096;
+
+    static const uint64_t MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+
 private:
 
+    enum State {
+        COMMAND,
+        AUTH,
+        DATA_PENDING,
+        DATA,
+        BDAT,
+        STARTTLS,
+        QUIT
+    };
+
+    // what the next reply of the server answers, in command order
+    enum Reply {
+        REPLY_OTHER,
+        REPLY_DATA,
+        REPLY_BDAT_LAST,
+        REPLY_STARTTLS
+    };
+
+    static const uint64_t MAX_PENDING_REPLIES = 64;
+
+    uint64_t feed_command(const char*, uint64_t);
+
+    uint64_t feed_data_pending(const char*, uint64_t);
+
+    void enter_data();
+
+    void handle_reply(cs::util::StringView);
+
+    void expect_reply(Reply);
+
+    uint64_t feed_data(const char*, uint64_t);
+
+    uint64_t feed_bdat(const char*, uint64_t);
+
+    void handle_command(cs::util::StringView);
+
+    void append_message(const char*, uint64_t);
+
+    void message_complete();
+
+    void held_message_complete(bool);
+
+    void reset_message();
+
+    void tls_upgraded();
+
+    void abandon_stream(Tins::TCPIP::Stream&);
+
+    State state_;
+
+    cs::util::LineBuffer command_buffer_;
+
+    cs::util::LineBuffer reply_buffer_;
+
+    std::deque<Reply> replies_;
+
+    //a line of message content starting with a dot
+    std::string line_;
+
+    bool at_line_start_;
+
+    uint64_t bdat_remain_;
+
+    bool bdat_last_;
+
+    Envelope envelope_;
+
+    std::string message_;
+
+    bool message_open_;
+
+    //a message sent with BDAT LAST waiting for the server to take it
+    CollectedData* held_message_;
+
+    bool abandoned_;
+
 };
 
 }
@@ -37,6 +37,12 @@ void SnifferManager::erase_sniffer(std::string sniffer_id) {
     }
 }
 
+void SnifferManager::tick(const std::chrono::steady_clock::time_point &now) {
+    for (auto& iter: sniffer_container) {
+        iter.second -> on_tick(now);
+    }
+}
+
 SnifferManager::SnifferManager() {
     sniffer_container.clear();
 }
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <map>
+#include <chrono>
 
 namespace cs {
 
@@ -25,6 +26,8 @@ public:
 
     void erase_sniffer(std::string);
 
+    void tick(const std::chrono::steady_clock::time_point &);
+
 private:
 
     std::map<std::string, cs::base::Sniffer *> sniffer_container;
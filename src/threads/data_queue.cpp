@@ -40,5 +40,16 @@ cs::base::CollectedData* DataQueue::dequeue()
     }
 }
 
+cs::base::CollectedData* DataQueue::try_dequeue()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (queue_.empty()) {
+        return nullptr;
+    }
+    cs::base::CollectedData* val = queue_.front();
+    queue_.pop();
+    return val;
+}
+
 }
 }
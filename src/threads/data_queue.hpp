@@ -25,6 +25,8 @@ public:
 
     cs::base::CollectedData* dequeue();
 
+    cs::base::CollectedData* try_dequeue();
+
 private:
     std::queue<cs::base::CollectedData*> queue_;
     mutable std::mutex mutex;
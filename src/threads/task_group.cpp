@@ -0,0 +1,108 @@
+#include "threads/task_group.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "cuckoo_sniffer.hpp"
+#include "threads/thread.hpp"
+
+namespace cs {
+namespace threads {
+
+//a failed job is logged and counted as done like any other
+static void run_job(const std::function<void()>& job) {
+    try {
+        job();
+    }
+    catch (std::exception& e) {
+        LOG_ERROR << "Task failed: " << e.what();
+    }
+    catch (...) {
+        LOG_ERROR << "Task failed.";
+    }
+}
+
+struct TaskGroup::State {
+    std::mutex mutex;
+    std::condition_variable done;
+    std::vector<std::function<void()>> jobs;
+    std::vector<bool> claimed;
+    uint64_t pending = 0;
+
+    //false if the job was already taken by someone else
+    bool execute(uint64_t index) {
+        std::function<void()> job;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (claimed[index])
+                return false;
+            claimed[index] = true;
+            job.swap(jobs[index]);
+        }
+        run_job(job);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0)
+            done.notify_all();
+        return true;
+    }
+};
+
+TaskGroup::TaskGroup() : state_(new State()) {}
+
+void TaskGroup::run(const std::function<void()>& job) {
+    if (get_threads_num() == 0) {
+        run_job(job);
+        return;
+    }
+    uint64_t index;
+    {
+        std::lock_guard<std::mutex> lock(state_ -> mutex);
+        index = state_ -> jobs.size();
+        state_ -> jobs.push_back(job);
+        state_ -> claimed.push_back(false);
+        ++state_ -> pending;
+    }
+    DATA_QUEUE.enqueue(new Task(state_, index));
+}
+
+void TaskGroup::wait() {
+    uint64_t size;
+    {
+        std::lock_guard<std::mutex> lock(state_ -> mutex);
+        size = state_ -> jobs.size();
+    }
+    for (uint64_t i = 0; i < size; ++i) {
+        state_ -> execute(i);
+    }
+    std::unique_lock<std::mutex> lock(state_ -> mutex);
+    while (state_ -> pending != 0) {
+        state_ -> done.wait(lock);
+    }
+}
+
+TaskGroup::~TaskGroup() {
+    wait();
+}
+
+Task::Task(const std::shared_ptr<TaskGroup::State>& state, uint64_t index)
+        : cs::base::CollectedData(TASK)
+        , state_(state)
+        , index_(index)
+{}
+
+void Task::execute() {
+    state_ -> execute(index_);
+}
+
+Task::~Task() {}
+
+int TaskProcessor::process(cs::base::CollectedData* collected_data) {
+    dynamic_cast<Task*>(collected_data) -> execute();
+    return 1;
+}
+
+TaskProcessor::~TaskProcessor() {}
+
+}
+}
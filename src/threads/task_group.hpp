@@ -0,0 +1,70 @@
+#ifndef CUCKOOSNIFFER_THREADS_TASK_GROUP_HPP
+#define CUCKOOSNIFFER_THREADS_TASK_GROUP_HPP
+
+#include <functional>
+#include <memory>
+
+#include "base/collected_data.hpp"
+#include "base/data_processor.hpp"
+
+namespace cs {
+namespace threads {
+
+// Jobs fanned out over the worker threads through the data queue. wait()
+// runs the jobs no worker has picked up yet on the calling thread and then
+// counts down the ones in flight, so a worker waiting on its own group never
+// waits for a queue nobody drains.
+class TaskGroup {
+
+public:
+
+    TaskGroup();
+
+    // runs the job right away when there are no worker threads
+    void run(const std::function<void()>&);
+
+    void wait();
+
+    // waits for what is still running
+    ~TaskGroup();
+
+    struct State;
+
+private:
+
+    std::shared_ptr<State> state_;
+
+};
+
+// One job of a group as it travels through the data queue.
+class Task : public cs::base::CollectedData {
+
+public:
+
+    Task(const std::shared_ptr<TaskGroup::State>&, uint64_t);
+
+    void execute();
+
+    virtual ~Task();
+
+private:
+
+    std::shared_ptr<TaskGroup::State> state_;
+    uint64_t index_;
+
+};
+
+class TaskProcessor : public cs::base::DataProcessor {
+
+public:
+
+    virtual int process(cs::base::CollectedData*);
+
+    virtual ~TaskProcessor();
+
+};
+
+}
+}
+
+#endif //CUCKOOSNIFFER_THREADS_TASK_GROUP_HPP
@@ -30,6 +30,7 @@ void thread_process() {
 
         processor -> process(collected_data);
 
+        delete processor;
         delete collected_data;
     }
     catch(std::exception(e)) {
@@ -59,5 +60,9 @@ void start_threads(int threads_num) {
 
 }
 
+int get_threads_num() {
+    return static_cast<int>(threads_vec.size());
+}
+
+}
 }
-}
\ No newline at end of file
@@ -6,6 +6,9 @@ namespace threads{
 
 void start_threads(int);
 
+// workers started so far, 0 when nothing is run in the background
+int get_threads_num();
+
 }
 }
 
@@ -2,6 +2,11 @@
 
 #include <iostream>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CS_BASE64_X86
+#include <immintrin.h>
+#endif
+
 namespace cs {
 namespace util {
 
@@ -11,10 +16,6 @@ static const std::string base64_chars =
                 "0123456789+/";
 
 
-static inline bool is_base64(unsigned char c) {
-    return (isalnum(c) || (c == '+') || (c == '/'));
-}
-
 std::string base64_encode(unsigned char const *bytes_to_encode, unsigned int in_len) {
     std::string ret;
     int i = 0;
@@ -58,45 +59,238 @@ std::string base64_encode(unsigned char const *bytes_to_encode, unsigned int in_
 }
 
 std::string base64_decode(std::string const &encoded_string) {
-    size_t in_len = encoded_string.size();
-    int i = 0;
-    int j = 0;
-    int in_ = 0;
-    unsigned char char_array_4[4], char_array_3[3];
-    std::string ret;
+    std::string ret(Base64Decoder::max_output(encoded_string.size()), '\0');
+    Base64Decoder decoder;
+    uint64_t size = decoder.feed(encoded_string.data(), encoded_string.size(), &ret[0]);
+    size += decoder.finish(&ret[size]);
+    ret.resize(size);
+    return ret;
+}
 
-    while (in_len-- && (encoded_string[in_] != '=') && is_base64(encoded_string[in_])) {
-        char_array_4[i++] = encoded_string[in_];
-        in_++;
-        if (i == 4) {
-            for (i = 0; i < 4; i++)
-                char_array_4[i] = static_cast<unsigned char>(base64_chars.find(char_array_4[i]));
+//value of each character, -1 outside the alphabet
+static const int8_t k_DECODE_TABLE[256] = {
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+        52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+        -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+        15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+        -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+        41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
 
-            char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-            char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-            char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+//decodes whole blocks of alphabet characters, returns the input used
+typedef uint64_t (*decode_function)(const char*, uint64_t, char*);
 
-            for (i = 0; (i < 3); i++)
-                ret += char_array_3[i];
-            i = 0;
-        }
+static uint64_t decode_blocks_scalar(const char* data, uint64_t len, char* out) {
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(data);
+    uint64_t i = 0;
+    for (; i + 4 <= len; i += 4) {
+        int8_t a = k_DECODE_TABLE[in[i]];
+        int8_t b = k_DECODE_TABLE[in[i + 1]];
+        int8_t c = k_DECODE_TABLE[in[i + 2]];
+        int8_t d = k_DECODE_TABLE[in[i + 3]];
+        if ((a | b | c | d) < 0)
+            break;
+        uint32_t quantum = static_cast<uint32_t>(a) << 18 | static_cast<uint32_t>(b) << 12 |
+                           static_cast<uint32_t>(c) << 6 | static_cast<uint32_t>(d);
+        out[0] = static_cast<char>(quantum >> 16);
+        out[1] = static_cast<char>(quantum >> 8);
+        out[2] = static_cast<char>(quantum);
+        out += 3;
     }
+    return i;
+}
 
-    if (i) {
-        for (j = i; j < 4; j++)
-            char_array_4[j] = 0;
+#ifdef CS_BASE64_X86
+
+//translate with nibble lookups and check the alphabet in the same step,
+//then pack four 6 bit values into three bytes
 
-        for (j = 0; j < 4; j++)
-            char_array_4[j] = static_cast<unsigned char>(base64_chars.find(char_array_4[j]));
+__attribute__((target("ssse3")))
+static uint64_t decode_blocks_ssse3(const char* data, uint64_t len, char* out) {
+    const __m128i lut_lo = _mm_setr_epi8(
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(
+            0, 16, 19, 4, -65, -65, -71, -71,
+            0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f = _mm_set1_epi8(0x2f);
 
-        char_array_3[0] = (char_array_4[0] << 2) + ((char_array_4[1] & 0x30) >> 4);
-        char_array_3[1] = ((char_array_4[1] & 0xf) << 4) + ((char_array_4[2] & 0x3c) >> 2);
-        char_array_3[2] = ((char_array_4[2] & 0x3) << 6) + char_array_4[3];
+    uint64_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask_2f);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(in, mask_2f));
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0)
+            break;
+        __m128i eq_2f = _mm_cmpeq_epi8(in, mask_2f);
+        __m128i values = _mm_add_epi8(in, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles)));
 
-        for (j = 0; (j < i - 1); j++) ret += char_array_3[j];
+        __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        packed = _mm_shuffle_epi8(packed, _mm_setr_epi8(
+                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), packed);
+        out += 12;
     }
+    return i + decode_blocks_scalar(data + i, len - i, out);
+}
 
-    return ret;
+__attribute__((target("avx2")))
+static uint64_t decode_blocks_avx2(const char* data, uint64_t len, char* out) {
+    const __m256i lut_lo = _mm256_setr_epi8(
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(
+            0, 16, 19, 4, -65, -65, -71, -71,
+            0, 0, 0, 0, 0, 0, 0, 0,
+            0, 16, 19, 4, -65, -65, -71, -71,
+            0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+
+    uint64_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask_2f);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(in, mask_2f));
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        if (!_mm256_testz_si256(lo, hi))
+            break;
+        __m256i eq_2f = _mm256_cmpeq_epi8(in, mask_2f);
+        __m256i values = _mm256_add_epi8(in, _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles)));
+
+        __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        __m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        packed = _mm256_shuffle_epi8(packed, _mm256_setr_epi8(
+                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), packed);
+        out += 24;
+    }
+    return i + decode_blocks_scalar(data + i, len - i, out);
+}
+
+#endif
+
+static decode_function select_decode() {
+#ifdef CS_BASE64_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return decode_blocks_avx2;
+    if (__builtin_cpu_supports("ssse3"))
+        return decode_blocks_ssse3;
+#endif
+    return decode_blocks_scalar;
+}
+
+Base64Decoder::Base64Decoder() :
+        quantum_(0),
+        quantum_len_(0),
+        padded_(false),
+        error_(false) {}
+
+uint64_t Base64Decoder::feed(const char* data, uint64_t len, char* out) {
+    static const decode_function decode_blocks = select_decode();
+
+    char* begin = out;
+    uint64_t i = 0;
+    while (i < len) {
+        //blocks only start on a quantum boundary and stop at the first line break
+        if (quantum_len_ == 0 && !padded_) {
+            uint64_t used = decode_blocks(data + i, len - i, out);
+            i += used;
+            out += used / 4 * 3;
+            if (i == len)
+                break;
+        }
+
+        unsigned char c = static_cast<unsigned char>(data[i++]);
+        int8_t value = k_DECODE_TABLE[c];
+        if (value >= 0) {
+            if (padded_) {
+                error_ = true;
+                continue;
+            }
+            quantum_ = quantum_ << 6 | static_cast<uint32_t>(value);
+            if (++quantum_len_ == 4) {
+                out[0] = static_cast<char>(quantum_ >> 16);
+                out[1] = static_cast<char>(quantum_ >> 8);
+                out[2] = static_cast<char>(quantum_);
+                out += 3;
+                quantum_ = 0;
+                quantum_len_ = 0;
+            }
+        }
+        else if (c == '=') {
+            if (quantum_len_ == 2) {
+                out[0] = static_cast<char>(quantum_ >> 4);
+                out += 1;
+            }
+            else if (quantum_len_ == 3) {
+                out[0] = static_cast<char>(quantum_ >> 10);
+                out[1] = static_cast<char>(quantum_ >> 2);
+                out += 2;
+            }
+            else if (!(quantum_len_ == 0 && padded_)) {
+                error_ = true;
+            }
+            quantum_ = 0;
+            quantum_len_ = 0;
+            padded_ = true;
+        }
+        else if (c != '\r' && c != '\n' && c != ' ' && c != '\t') {
+            error_ = true;
+        }
+    }
+    return out - begin;
+}
+
+uint64_t Base64Decoder::finish(char* out) {
+    uint64_t size = 0;
+    if (quantum_len_ == 2) {
+        out[0] = static_cast<char>(quantum_ >> 4);
+        size = 1;
+    }
+    else if (quantum_len_ == 3) {
+        out[0] = static_cast<char>(quantum_ >> 10);
+        out[1] = static_cast<char>(quantum_ >> 2);
+        size = 2;
+    }
+    else if (quantum_len_ == 1) {
+        error_ = true;
+    }
+    quantum_ = 0;
+    quantum_len_ = 0;
+    return size;
+}
+
+bool Base64Decoder::is_error() const {
+    return error_;
+}
+
+uint64_t Base64Decoder::max_output(uint64_t len) {
+    return len / 4 * 3 + 32;
 }
 
 }
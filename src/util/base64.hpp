@@ -2,6 +2,7 @@
 #define CUCKOOSNIFFER_UTIL_BASE64_HPP
 
 #include <string>
+#include <cstdint>
 
 namespace cs {
 namespace util {
@@ -10,6 +11,38 @@ std::string base64_encode(unsigned char const *, unsigned int len);
 
 std::string base64_decode(std::string const &s);
 
+// Decodes base64 as it arrives in pieces of any size, line breaks and other
+// whitespace are skipped. Runs of clean input are decoded with AVX2 or
+// SSSE3 when the cpu has them.
+class Base64Decoder {
+
+public:
+
+    Base64Decoder();
+
+    // writes the decoded bytes, the output needs max_output() of the input
+    // length, returns the bytes written
+    uint64_t feed(const char*, uint64_t, char*);
+
+    // flushes an unpadded tail, at most 2 bytes
+    uint64_t finish(char*);
+
+    // characters outside the alphabet, data after padding or a cut quantum
+    bool is_error() const;
+
+    // room for the output of that much input, including what the vector
+    // stores write past the end
+    static uint64_t max_output(uint64_t);
+
+private:
+
+    uint32_t quantum_;
+    int quantum_len_;
+    bool padded_;
+    bool error_;
+
+};
+
 }
 }
 
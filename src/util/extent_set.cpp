@@ -0,0 +1,78 @@
+#include "util/extent_set.hpp"
+
+#include <iterator>
+
+namespace cs {
+namespace util {
+
+ExtentSet::ExtentSet() {
+    covered_ = 0;
+}
+
+void ExtentSet::add(uint64_t offset, uint64_t len) {
+    if (len == 0) {
+        return;
+    }
+    uint64_t start = offset;
+    uint64_t end = offset + len;
+
+    //merge with the extent starting before us if it reaches us
+    auto iter = extents_.upper_bound(start);
+    if (iter != extents_.begin()) {
+        auto prev = std::prev(iter);
+        if (prev -> second >= start) {
+            if (prev -> second >= end) {
+                return;
+            }
+            start = prev -> first;
+            covered_ -= prev -> second - prev -> first;
+            iter = extents_.erase(prev);
+        }
+    }
+    //swallow every extent starting inside us
+    while (iter != extents_.end() && iter -> first <= end) {
+        if (iter -> second > end) {
+            end = iter -> second;
+        }
+        covered_ -= iter -> second - iter -> first;
+        iter = extents_.erase(iter);
+    }
+    extents_[start] = end;
+    covered_ += end - start;
+}
+
+bool ExtentSet::contains(uint64_t offset, uint64_t len) const {
+    auto iter = extents_.upper_bound(offset);
+    if (iter == extents_.begin()) {
+        return len == 0;
+    }
+    --iter;
+    return iter -> second >= offset + len;
+}
+
+uint64_t ExtentSet::get_covered() const {
+    return covered_;
+}
+
+uint64_t ExtentSet::get_contiguous_end() const {
+    if (extents_.empty() || extents_.begin() -> first != 0) {
+        return 0;
+    }
+    return extents_.begin() -> second;
+}
+
+bool ExtentSet::is_complete(uint64_t size) const {
+    return get_contiguous_end() >= size;
+}
+
+bool ExtentSet::empty() const {
+    return extents_.empty();
+}
+
+void ExtentSet::clear() {
+    extents_.clear();
+    covered_ = 0;
+}
+
+}
+}
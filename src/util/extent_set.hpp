@@ -0,0 +1,44 @@
+#ifndef CUCKOOSNIFFER_UTIL_EXTENT_SET_HPP
+#define CUCKOOSNIFFER_UTIL_EXTENT_SET_HPP
+
+#include <map>
+#include <cstdint>
+
+namespace cs {
+namespace util {
+
+// Byte ranges of a file that have been seen, adjacent and overlapping
+// ranges are merged.
+class ExtentSet {
+
+public:
+
+    ExtentSet();
+
+    void add(uint64_t, uint64_t);
+
+    bool contains(uint64_t, uint64_t) const;
+
+    uint64_t get_covered() const;
+
+    uint64_t get_contiguous_end() const;
+
+    bool is_complete(uint64_t) const;
+
+    bool empty() const;
+
+    void clear();
+
+private:
+
+    // start -> end (exclusive)
+    std::map<uint64_t, uint64_t> extents_;
+
+    uint64_t covered_;
+
+};
+
+}
+}
+
+#endif //CUCKOOSNIFFER_UTIL_EXTENT_SET_HPP
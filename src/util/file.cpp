@@ -4,26 +4,56 @@
 #include <cstring>
 #include <cuckoo_sniffer.hpp>
 
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "threads/task_group.hpp"
 #include "util/function.hpp"
 
 
 namespace cs {
 namespace util {
 
+//a multiple of the huge page size so mapped chunks can use huge pages
+static const uint64_t CHUNK_SIZE = 2 * 1024 * 1024;
+
+//below this the final hashing pass is not split over the worker threads
+static const uint64_t PARALLEL_HASH_SIZE = 16 * 1024 * 1024;
+
+uint64_t File::map_threshold_ = 64 * 1024 * 1024;
+bool File::huge_pages_ = false;
+
 File::File() {
-    buffer_ = nullptr;
+    first_size_ = 0;
     buffer_end_ = 0;
-    buffer_size_ = 0;
+    joined_ = nullptr;
+    joined_size_ = 0;
+    fd_ = -1;
 }
 
 bool File::write_to_pos(const char* data, uint64_t size, uint64_t offset) {
-    if (offset + size > buffer_size_) {
-        bool ret = set_size(offset + size);
+    if (offset + size > get_capacity()) {
+        //grow geometrically while the file fits in the first chunk
+        uint64_t new_size = first_size_ * 2 > offset + size ? first_size_ * 2 : offset + size;
+        bool ret = set_size(new_size);
         if (!ret)
             return false;
     }
-    memcpy(buffer_ + offset, data, size);
-    buffer_end_ = buffer_end_ > offset + size ? buffer_end_: offset + size;
+    uint64_t end = offset + size;
+    while (size > 0) {
+        uint64_t index = offset / CHUNK_SIZE;
+        uint64_t chunk_offset = offset % CHUNK_SIZE;
+        uint64_t len = CHUNK_SIZE - chunk_offset < size ? CHUNK_SIZE - chunk_offset : size;
+        memcpy(chunks_[index] + chunk_offset, data, len);
+        data += len;
+        offset += len;
+        size -= len;
+    }
+    buffer_end_ = buffer_end_ > end ? buffer_end_: end;
+    release_joined();
+    digest_ = Digest();
     return true;
 }
 
@@ -32,29 +62,179 @@ bool File::write(const char* data, uint64_t size) {
 }
 
 bool File::set_size(uint64_t size) {
-    if (size > buffer_size_) {
-        char* new_buffer = nullptr;
-        try {
-            new_buffer = new char[size];
-        }
-        catch (std::bad_alloc){
-            LOG_ERROR << "Alloc new buffer in file failed.";
+    if (size <= get_capacity())
+        return true;
+    if (fd_ >= 0 || (map_threshold_ != 0 && size > map_threshold_)) {
+        if (map_chunks(size))
+            return true;
+        if (fd_ >= 0)
             return false;
+        LOG_DEBUG << "Map file failed, keep it on the heap.";
+    }
+    try {
+        //holes left by out of order writes read as zeros
+        if (first_size_ < CHUNK_SIZE) {
+            uint64_t new_size = size < CHUNK_SIZE ? size : CHUNK_SIZE;
+            char* new_chunk = new char[new_size]();
+            if (!chunks_.empty()) {
+                memcpy(new_chunk, chunks_[0], buffer_end_);
+                delete[] chunks_[0];
+                chunks_[0] = new_chunk;
+            }
+            else {
+                chunks_.push_back(new_chunk);
+            }
+            first_size_ = new_size;
+        }
+        while (get_capacity() < size) {
+            chunks_.push_back(new char[CHUNK_SIZE]());
         }
-        memcpy(new_buffer, buffer_, buffer_end_);
-        buffer_size_ = size;
-        delete[] buffer_;
-        buffer_ = new_buffer;
     }
-    return false;
+    catch (std::bad_alloc){
+        LOG_ERROR << "Alloc new buffer in file failed.";
+        return false;
+    }
+    return true;
 }
 
 uint64_t File::get_size() const {
     return buffer_end_;
 }
 
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+//maps the chunks from first up to size of a memfd, nothing is left mapped on failure
+static bool map_range(int fd, uint64_t first, uint64_t size, std::vector<char*>& chunks) {
+    uint64_t chunk_num = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    bool ok = ftruncate(fd, chunk_num * CHUNK_SIZE) == 0;
+    for (uint64_t i = first; ok && i < chunk_num; ++i) {
+        void* chunk = mmap(nullptr, CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, i * CHUNK_SIZE);
+        ok = chunk != MAP_FAILED;
+        if (ok)
+            chunks.push_back(static_cast<char*>(chunk));
+    }
+    if (!ok) {
+        for (char* chunk: chunks) {
+            munmap(chunk, CHUNK_SIZE);
+        }
+        chunks.clear();
+    }
+    return ok;
+}
+#endif
+
+//grows the memfd the file is in, or moves the file into a new one
+bool File::map_chunks(uint64_t size) {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    std::vector<char*> chunks;
+    if (fd_ >= 0) {
+        if (!map_range(fd_, chunks_.size(), size, chunks)) {
+            LOG_ERROR << "Grow mapped file failed.";
+            return false;
+        }
+        chunks_.insert(chunks_.end(), chunks.begin(), chunks.end());
+        return true;
+    }
+
+    int fd = -1;
+#ifdef MFD_HUGETLB
+    if (huge_pages_) {
+        fd = memfd_create("cuckoo_file", MFD_CLOEXEC | MFD_HUGETLB);
+        if (fd >= 0 && !map_range(fd, 0, size, chunks)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+#endif
+    if (fd < 0) {
+        fd = memfd_create("cuckoo_file", MFD_CLOEXEC);
+        if (fd < 0)
+            return false;
+        if (!map_range(fd, 0, size, chunks)) {
+            close(fd);
+            return false;
+        }
+    }
+
+    //what is on the heap so far is copied over once
+    release_joined();
+    std::vector<Slice> slices = get_slices();
+    for (uint64_t i = 0; i < slices.size(); ++i) {
+        memcpy(chunks[i], slices[i].data, slices[i].size);
+    }
+    for (char* chunk: chunks_) {
+        delete[] chunk;
+    }
+    chunks_.swap(chunks);
+    first_size_ = CHUNK_SIZE;
+    fd_ = fd;
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint64_t File::get_capacity() const {
+    return chunks_.empty() ? 0 : first_size_ + (chunks_.size() - 1) * CHUNK_SIZE;
+}
+
+std::vector<File::Slice> File::get_slices() const {
+    std::vector<Slice> slices;
+    for (uint64_t i = 0; i < chunks_.size() && i * CHUNK_SIZE < buffer_end_; ++i) {
+        uint64_t len = buffer_end_ - i * CHUNK_SIZE;
+        slices.push_back({chunks_[i], len < CHUNK_SIZE ? len : CHUNK_SIZE});
+    }
+    return slices;
+}
+
 std::string File::get_md5() {
-    return md5(buffer_, buffer_end_);
+    return get_digest().md5;
+}
+
+//each algorithm over the whole content, one job per algorithm for large files
+static Digest hash_slices(const std::vector<File::Slice>& slices, uint64_t size) {
+    if (size < PARALLEL_HASH_SIZE) {
+        Hasher hasher;
+        for (const auto& slice: slices) {
+            hasher.update(slice.data, slice.size);
+        }
+        return hasher.finish();
+    }
+
+    Digest digests[3];
+    const int algorithms[3] = {Hasher::MD5, Hasher::SHA1, Hasher::SHA256};
+    {
+        threads::TaskGroup group;
+        for (int i = 0; i < 3; ++i) {
+            Digest& digest = digests[i];
+            int algorithm = algorithms[i];
+            group.run([&slices, &digest, algorithm]() {
+                Hasher hasher(algorithm);
+                for (const auto& slice: slices) {
+                    hasher.update(slice.data, slice.size);
+                }
+                digest = hasher.finish();
+            });
+        }
+        group.wait();
+    }
+
+    Digest digest;
+    digest.md5 = digests[0].md5;
+    digest.sha1 = digests[1].sha1;
+    digest.sha256 = digests[2].sha256;
+    return digest;
+}
+
+const Digest& File::get_digest() {
+    //not hashed while the data arrived, do a final pass
+    if (digest_.md5.empty()) {
+        digest_ = hash_slices(get_slices(), buffer_end_);
+    }
+    return digest_;
+}
+
+void File::set_digest(const Digest& digest) {
+    digest_ = digest;
 }
 
 const std::string& File::get_mime_type() const {
@@ -75,12 +255,70 @@ void File::set_name(const std::string& name) {
 
 
 File::~File() {
-    if (buffer_ != nullptr)
-        delete[] buffer_;
+    release_joined();
+#ifdef __linux__
+    if (fd_ >= 0) {
+        for (char* chunk: chunks_) {
+            munmap(chunk, CHUNK_SIZE);
+        }
+        close(fd_);
+        return;
+    }
+#endif
+    for (char* chunk: chunks_) {
+        delete[] chunk;
+    }
 }
 
 const char* File::get_buffer() const {
-    return buffer_;
+    if (chunks_.size() <= 1)
+        return chunks_.empty() ? nullptr : chunks_[0];
+#ifdef __linux__
+    if (joined_ == nullptr && fd_ >= 0) {
+        //whole chunks, hugetlb mappings are only unmapped in huge page multiples
+        uint64_t size = (buffer_end_ + CHUNK_SIZE - 1) / CHUNK_SIZE * CHUNK_SIZE;
+        void* joined = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0);
+        if (joined != MAP_FAILED) {
+            joined_ = static_cast<char*>(joined);
+            joined_size_ = size;
+        }
+    }
+#endif
+    if (joined_ == nullptr) {
+        joined_ = new char[buffer_end_];
+        uint64_t pos = 0;
+        for (const auto& slice: get_slices()) {
+            memcpy(joined_ + pos, slice.data, slice.size);
+            pos += slice.size;
+        }
+    }
+    return joined_;
+}
+
+int File::get_fd() const {
+    return fd_;
+}
+
+void File::set_map_threshold(uint64_t threshold) {
+    map_threshold_ = threshold;
+}
+
+void File::set_huge_pages(bool huge_pages) {
+    huge_pages_ = huge_pages;
+}
+
+void File::release_joined() {
+#ifdef __linux__
+    //joined by mapping the memfd again
+    if (joined_size_ != 0) {
+        munmap(joined_, joined_size_);
+        joined_ = nullptr;
+        joined_size_ = 0;
+        return;
+    }
+#endif
+    delete[] joined_;
+    joined_ = nullptr;
 }
 
 }
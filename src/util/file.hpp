@@ -3,24 +3,48 @@
 
 #include <string>
 #include <sstream>
+#include <vector>
+
+#include "util/hash.hpp"
 
 namespace cs {
 namespace util {
 
+// File content kept in fixed size chunks, so appends and positional writes
+// never move what is already stored. Files that fit in one chunk use a
+// single buffer grown geometrically. Large files are kept in a memfd mapping
+// instead of the heap, the pages go back to the system when the file is
+// destroyed and the content can be handed on by descriptor.
 class File {
 
 public:
 
+    // a run of the content as it is stored
+    struct Slice {
+        const char* data;
+        uint64_t size;
+    };
+
     File();
 
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+
     bool write(const char*, uint64_t);
     bool write_to_pos(const char*, uint64_t, uint64_t);
 
+    // room for that much content, holes read as zeros
     bool set_size(uint64_t);
     uint64_t get_size() const;
 
+    // the content in order without copying it
+    std::vector<Slice> get_slices() const;
+
     std::string get_md5();
 
+    const Digest& get_digest();
+    void set_digest(const Digest&);
+
     const std::string& get_mime_type() const;
     void set_mime_type(const std::string&);
 
@@ -30,17 +54,43 @@ public:
 
     ~File();
 
+    // the content in one piece, chunks are joined into a copy on demand,
+    // mapped files are mapped once more in one piece instead
     const char* get_buffer() const;
 
+    // the memfd holding a mapped file, its first get_size() bytes are the
+    // content, -1 for files on the heap
+    int get_fd() const;
+
+    // files reserved or grown past this many bytes are mapped, 0 to disable
+    static void set_map_threshold(uint64_t);
+
+    // back mapped files with huge pages when the system has them reserved
+    static void set_huge_pages(bool);
+
 private:
-    char* buffer_;
+    std::vector<char*> chunks_;
 
+    //capacity of the first chunk, less than a whole chunk for small files
+    uint64_t first_size_;
     uint64_t buffer_end_;
-    uint64_t buffer_size_;
+
+    mutable char* joined_;
+    mutable uint64_t joined_size_;
+
+    int fd_;
 
     std::string mime_type_;
     std::string name_;
 
+    Digest digest_;
+
+    static uint64_t map_threshold_;
+    static bool huge_pages_;
+
+    uint64_t get_capacity() const;
+    bool map_chunks(uint64_t);
+    void release_joined();
 
 };
 
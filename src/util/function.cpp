@@ -1,15 +1,17 @@
 #include "function.hpp"
 
+#include <cstring>
 #include <sstream>
 
-#include <openssl/md5.h>
 #include <curl/curl.h>
+#include <openssl/evp.h>
 
 #include "tins/tcp_ip/stream_follower.h"
 #include "tins/ip_address.h"
 #include "tins/ipv6_address.h"
 
 #include "util/file.hpp"
+#include "util/hash.hpp"
 
 namespace cs {
 namespace util {
@@ -55,18 +57,40 @@ std::string stream_identifier(const Tins::TCPIP::Stream &stream) {
 }
 
 std::string md5(const char* data, size_t size) {
-    unsigned char md[16];
-    std::ostringstream os;
-    MD5(reinterpret_cast<const unsigned char*>(data), size, md);
-    os << std::setw(2) << std::setfill('0') << std::hex << std::uppercase;
-    for (int i = 0; i < 16; ++i) {
-        os << std::setw(2) << static_cast<int>(md[i]);
-    }
-    return os.str();
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    EVP_Digest(data, size, md, &len, EVP_md5(), nullptr);
+    return to_hex(md, len);
 }
 
 
 
+//hands the slices of a file to curl as it asks for them, without joining them
+struct SliceReader {
+    std::vector<File::Slice> slices;
+    uint64_t index;
+    uint64_t offset;
+};
+
+static size_t read_slices(char* buffer, size_t size, size_t nitems, void* arg) {
+    SliceReader* reader = static_cast<SliceReader*>(arg);
+    size_t room = size * nitems;
+    size_t written = 0;
+    while (written < room && reader -> index < reader -> slices.size()) {
+        const File::Slice& slice = reader -> slices[reader -> index];
+        uint64_t len = slice.size - reader -> offset;
+        len = len < room - written ? len : room - written;
+        memcpy(buffer + written, slice.data + reader -> offset, len);
+        written += len;
+        reader -> offset += len;
+        if (reader -> offset == slice.size) {
+            ++reader -> index;
+            reader -> offset = 0;
+        }
+    }
+    return written;
+}
+
 int submit_file(const File& f, const char* url)
 {
 
@@ -90,20 +114,21 @@ int submit_file(const File& f, const char* url)
 
         const std::string& name = f.get_name();
         const std::string& mime_type = f.get_mime_type();
-
+        SliceReader reader = {f.get_slices(), 0, 0};
 
         curl_formadd(
                 &formpost,
                 &lastptr,
                 CURLFORM_COPYNAME, "file",
-                CURLFORM_BUFFER, name.c_str(),
-                CURLFORM_BUFFERPTR, f.get_buffer(),
-                CURLFORM_BUFFERLENGTH, f.get_size(),
+                CURLFORM_FILENAME, name.c_str(),
+                CURLFORM_STREAM, &reader,
+                CURLFORM_CONTENTLEN, static_cast<curl_off_t>(f.get_size()),
                 CURLFORM_CONTENTTYPE, mime_type.c_str(),
                 CURLFORM_END
         );
 
         curl_easy_setopt(curl, CURLOPT_HTTPPOST, formpost);
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_slices);
 
 
         /* Perform the request, res will get the return code */
@@ -0,0 +1,90 @@
+#include "util/hash.hpp"
+
+#include <openssl/evp.h>
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define EVP_MD_CTX_new EVP_MD_CTX_create
+#define EVP_MD_CTX_free EVP_MD_CTX_destroy
+#endif
+
+namespace cs {
+namespace util {
+
+//every byte value as its two hex digits
+static const char k_HEX_TABLE[] =
+        "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+        "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+        "404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+        "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+        "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+        "A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+        "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+        "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+std::string to_hex(const unsigned char* data, uint64_t len) {
+    std::string ret(len * 2, '0');
+    for (uint64_t i = 0; i < len; ++i) {
+        ret[i * 2] = k_HEX_TABLE[data[i] * 2];
+        ret[i * 2 + 1] = k_HEX_TABLE[data[i] * 2 + 1];
+    }
+    return ret;
+}
+
+static std::string finish_ctx(EVP_MD_CTX* ctx) {
+    if (ctx == nullptr)
+        return std::string();
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    EVP_DigestFinal_ex(ctx, md, &len);
+    return to_hex(md, len);
+}
+
+static EVP_MD_CTX* new_ctx(const EVP_MD* md) {
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(ctx, md, nullptr);
+    return ctx;
+}
+
+Hasher::Hasher(int algorithms) {
+    md5_ctx_ = algorithms & MD5 ? new_ctx(EVP_md5()) : nullptr;
+    sha1_ctx_ = algorithms & SHA1 ? new_ctx(EVP_sha1()) : nullptr;
+    sha256_ctx_ = algorithms & SHA256 ? new_ctx(EVP_sha256()) : nullptr;
+    size_ = 0;
+}
+
+void Hasher::update(const char* data, uint64_t size) {
+    if (md5_ctx_ != nullptr)
+        EVP_DigestUpdate(md5_ctx_, data, size);
+    if (sha1_ctx_ != nullptr)
+        EVP_DigestUpdate(sha1_ctx_, data, size);
+    if (sha256_ctx_ != nullptr)
+        EVP_DigestUpdate(sha256_ctx_, data, size);
+    size_ += size;
+}
+
+Digest Hasher::finish() {
+    Digest digest;
+    digest.md5 = finish_ctx(md5_ctx_);
+    digest.sha1 = finish_ctx(sha1_ctx_);
+    digest.sha256 = finish_ctx(sha256_ctx_);
+    return digest;
+}
+
+uint64_t Hasher::get_size() const {
+    return size_;
+}
+
+Hasher::~Hasher() {
+    EVP_MD_CTX_free(md5_ctx_);
+    EVP_MD_CTX_free(sha1_ctx_);
+    EVP_MD_CTX_free(sha256_ctx_);
+}
+
+Digest hash(const char* data, uint64_t size) {
+    Hasher hasher;
+    hasher.update(data, size);
+    return hasher.finish();
+}
+
+}
+}
@@ -0,0 +1,63 @@
+#ifndef CUCKOOSNIFFER_UTIL_HASH_HPP
+#define CUCKOOSNIFFER_UTIL_HASH_HPP
+
+#include <string>
+#include <cstdint>
+
+struct evp_md_ctx_st;
+
+namespace cs {
+namespace util {
+
+struct Digest {
+    std::string md5;
+    std::string sha1;
+    std::string sha256;
+};
+
+// Streaming MD5/SHA-1/SHA-256 over data that arrives in order. Goes through
+// OpenSSL EVP, which uses the SHA extensions of the cpu when it has them.
+class Hasher {
+
+public:
+
+    enum Algorithm {
+        MD5 = 1,
+        SHA1 = 2,
+        SHA256 = 4,
+        ALL = MD5 | SHA1 | SHA256
+    };
+
+    // only the algorithms asked for are run, the other digests stay empty
+    explicit Hasher(int algorithms = ALL);
+
+    Hasher(const Hasher&) = delete;
+    Hasher& operator=(const Hasher&) = delete;
+
+    void update(const char*, uint64_t);
+
+    Digest finish();
+
+    uint64_t get_size() const;
+
+    ~Hasher();
+
+private:
+
+    evp_md_ctx_st* md5_ctx_;
+    evp_md_ctx_st* sha1_ctx_;
+    evp_md_ctx_st* sha256_ctx_;
+
+    uint64_t size_;
+
+};
+
+Digest hash(const char*, uint64_t);
+
+// upper case hex, two characters a byte
+std::string to_hex(const unsigned char*, uint64_t);
+
+}
+}
+
+#endif //CUCKOOSNIFFER_UTIL_HASH_HPP
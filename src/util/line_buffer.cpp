@@ -0,0 +1,70 @@
+#include "util/line_buffer.hpp"
+
+#include <cstring>
+
+namespace cs {
+namespace util {
+
+LineBuffer::LineBuffer(uint64_t max_size) :
+        max_size_(max_size),
+        line_out_(false),
+        skipping_(false),
+        overflowed_(false) {}
+
+bool LineBuffer::next(const char*& data, uint64_t& len, StringView& line) {
+    if (line_out_) {
+        line_.clear();
+        line_out_ = false;
+    }
+
+    while (len > 0) {
+        const char* end = static_cast<const char*>(memchr(data, '\n', len));
+        uint64_t used = end == nullptr ? len : end - data + 1;
+        const char* begin = data;
+        data += used;
+        len -= used;
+
+        uint64_t line_len = end == nullptr ? used : used - 1;
+        if (!skipping_ && line_.size() + line_len > max_size_) {
+            overflowed_ = true;
+            skipping_ = true;
+            line_.clear();
+        }
+        if (skipping_) {
+            if (end != nullptr)
+                skipping_ = false;
+            continue;
+        }
+
+        if (end == nullptr) {
+            line_.append(begin, line_len);
+            return false;
+        }
+
+        if (line_.empty()) {
+            line = StringView(begin, line_len);
+        }
+        else {
+            line_.append(begin, line_len);
+            line = StringView(line_);
+            line_out_ = true;
+        }
+        if (!line.empty() && line.data[line.size - 1] == '\r')
+            --line.size;
+        return true;
+    }
+    return false;
+}
+
+bool LineBuffer::has_overflowed() const {
+    return overflowed_;
+}
+
+void LineBuffer::clear() {
+    std::string().swap(line_);
+    line_out_ = false;
+    skipping_ = false;
+}
+
+}
+}
@@ -0,0 +1,48 @@
+#ifndef CUCKOOSNIFFER_UTIL_LINE_BUFFER_HPP
+#define CUCKOOSNIFFER_UTIL_LINE_BUFFER_HPP
+
+#include <string>
+#include <cstdint>
+
+#include "util/tokenizer.hpp"
+
+namespace cs {
+namespace util {
+
+// Cuts the bytes of one direction of a connection into lines. A line that
+// lies in one segment is handed out in place, only one cut by a segment
+// boundary is copied together. Lines over the maximum are dropped.
+class LineBuffer {
+
+public:
+
+    explicit LineBuffer(uint64_t);
+
+    // consumes bytes up to the end of the next line and points the view
+    // at it without the line break, false once the bytes are used up
+    bool next(const char*&, uint64_t&, StringView&);
+
+    bool has_overflowed() const;
+
+    void clear();
+
+private:
+
+    uint64_t max_size_;
+
+    std::string line_;
+
+    //line_ was handed out and is cleared on the next call
+    bool line_out_;
+
+    //the rest of a line over the maximum is skipped
+    bool skipping_;
+
+    bool overflowed_;
+
+};
+
+}
+}
+
+#endif //CUCKOOSNIFFER_UTIL_LINE_BUFFER_HPP
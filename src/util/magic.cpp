@@ -0,0 +1,138 @@
+#include "util/magic.hpp"
+
+#include <cstring>
+#include <vector>
+
+namespace cs {
+namespace util {
+
+struct Signature {
+    uint64_t offset;
+    const char* bytes;
+    uint64_t len;
+    MagicType type;
+};
+
+#define SIGNATURE(offset, bytes, type) {offset, bytes, sizeof(bytes) - 1, type}
+
+static const Signature k_SIGNATURES[] = {
+        SIGNATURE(0, "MZ",                                  MAGIC_PE),
+        SIGNATURE(0, "\x7f" "ELF",                          MAGIC_ELF),
+        SIGNATURE(0, "\xfe\xed\xfa\xce",                    MAGIC_MACHO),
+        SIGNATURE(0, "\xfe\xed\xfa\xcf",                    MAGIC_MACHO),
+        SIGNATURE(0, "\xce\xfa\xed\xfe",                    MAGIC_MACHO),
+        SIGNATURE(0, "\xcf\xfa\xed\xfe",                    MAGIC_MACHO),
+        SIGNATURE(0, "PK\x03\x04",                          MAGIC_ZIP),
+        SIGNATURE(0, "PK\x05\x06",                          MAGIC_ZIP),
+        SIGNATURE(0, "PK\x07\x08",                          MAGIC_ZIP),
+        SIGNATURE(0, "Rar!\x1a\x07",                        MAGIC_RAR),
+        SIGNATURE(0, "7z\xbc\xaf\x27\x1c",                  MAGIC_7Z),
+        SIGNATURE(0, "\x1f\x8b",                            MAGIC_GZIP),
+        SIGNATURE(0, "MSCF",                                MAGIC_CAB),
+        SIGNATURE(0, "\xd0\xcf\x11\xe0\xa1\xb1\x1a\xe1",    MAGIC_OLE),
+        SIGNATURE(0, "%PDF-",                               MAGIC_PDF),
+        SIGNATURE(0, "{\\rtf",                              MAGIC_RTF),
+        SIGNATURE(0, "#!",                                  MAGIC_SCRIPT),
+        SIGNATURE(0, "<?php",                               MAGIC_SCRIPT),
+        SIGNATURE(0, "\xff\xd8\xff",                        MAGIC_IMAGE),
+        SIGNATURE(0, "\x89PNG\r\n\x1a\n",                   MAGIC_IMAGE),
+        SIGNATURE(0, "GIF87a",                              MAGIC_IMAGE),
+        SIGNATURE(0, "GIF89a",                              MAGIC_IMAGE),
+        SIGNATURE(0, "II*\0",                               MAGIC_IMAGE),
+        SIGNATURE(0, "MM\0*",                               MAGIC_IMAGE),
+        SIGNATURE(0, "RIFF",                                MAGIC_MEDIA),
+        SIGNATURE(0, "ID3",                                 MAGIC_MEDIA),
+        SIGNATURE(0, "OggS",                                MAGIC_MEDIA),
+        SIGNATURE(0, "fLaC",                                MAGIC_MEDIA),
+        SIGNATURE(0, "FLV\x01",                             MAGIC_MEDIA),
+        SIGNATURE(0, "\x1a\x45\xdf\xa3",                    MAGIC_MEDIA),
+        SIGNATURE(4, "ftyp",                                MAGIC_MEDIA),
+};
+
+#undef SIGNATURE
+
+static const char* k_MIME_TYPES[MAGIC_TYPE_NUM] = {
+        "",
+        "application/x-msdownload",
+        "application/x-executable",
+        "application/x-mach-binary",
+        "application/zip",
+        "application/vnd.openxmlformats-officedocument",
+        "application/x-rar-compressed",
+        "application/x-7z-compressed",
+        "application/gzip",
+        "application/vnd.ms-cab-compressed",
+        "application/x-ole-storage",
+        "application/pdf",
+        "application/rtf",
+        "text/x-script",
+        "image",
+        "video",
+};
+
+//signatures at the start grouped by their first byte, the rest are tried on every file
+struct SignatureIndex {
+    std::vector<const Signature*> by_first_byte[256];
+    std::vector<const Signature*> others;
+
+    SignatureIndex() {
+        for (const auto& signature: k_SIGNATURES) {
+            if (signature.offset == 0)
+                by_first_byte[static_cast<uint8_t>(signature.bytes[0])].push_back(&signature);
+            else
+                others.push_back(&signature);
+        }
+    }
+};
+
+static const SignatureIndex& get_signature_index() {
+    static const SignatureIndex index;
+    return index;
+}
+
+static bool match(const Signature& signature, const char* data, uint64_t len) {
+    return len >= signature.offset + signature.len &&
+           memcmp(data + signature.offset, signature.bytes, signature.len) == 0;
+}
+
+MagicType classify_magic(const char* data, uint64_t len) {
+    if (len == 0)
+        return MAGIC_UNKNOWN;
+
+    const SignatureIndex& index = get_signature_index();
+    const Signature* found = nullptr;
+    for (const Signature* signature: index.by_first_byte[static_cast<uint8_t>(data[0])]) {
+        if (match(*signature, data, len)) {
+            found = signature;
+            break;
+        }
+    }
+    for (auto iter = index.others.begin(); found == nullptr && iter != index.others.end(); ++iter) {
+        if (match(**iter, data, len))
+            found = *iter;
+    }
+    if (found == nullptr)
+        return MAGIC_UNKNOWN;
+
+    //office documents are zip archives that start with their content types
+    static const char k_CONTENT_TYPES[] = "[Content_Types].xml";
+    if (found -> type == MAGIC_ZIP && len >= 30 + sizeof(k_CONTENT_TYPES) - 1 &&
+            memcmp(data + 30, k_CONTENT_TYPES, sizeof(k_CONTENT_TYPES) - 1) == 0)
+        return MAGIC_OOXML;
+    return found -> type;
+}
+
+bool is_wanted_magic(MagicType type) {
+    return type != MAGIC_UNKNOWN && !is_unwanted_magic(type);
+}
+
+bool is_unwanted_magic(MagicType type) {
+    return type == MAGIC_IMAGE || type == MAGIC_MEDIA;
+}
+
+const char* get_magic_mime_type(MagicType type) {
+    return type < MAGIC_TYPE_NUM ? k_MIME_TYPES[type] : "";
+}
+
+}
+}
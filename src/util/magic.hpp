@@ -0,0 +1,50 @@
+#ifndef CUCKOOSNIFFER_UTIL_MAGIC_HPP
+#define CUCKOOSNIFFER_UTIL_MAGIC_HPP
+
+#include <cstdint>
+
+namespace cs {
+namespace util {
+
+// What the first bytes of a file say it is, whatever it was declared as.
+enum MagicType {
+    MAGIC_UNKNOWN,
+    MAGIC_PE,
+    MAGIC_ELF,
+    MAGIC_MACHO,
+    MAGIC_ZIP,
+    MAGIC_OOXML,
+    MAGIC_RAR,
+    MAGIC_7Z,
+    MAGIC_GZIP,
+    MAGIC_CAB,
+    MAGIC_OLE,
+    MAGIC_PDF,
+    MAGIC_RTF,
+    MAGIC_SCRIPT,
+    MAGIC_IMAGE,
+    MAGIC_MEDIA,
+    MAGIC_TYPE_NUM
+};
+
+// how much of the start of a file classify_magic() looks at
+const uint64_t MAGIC_HEADER_SIZE = 512;
+
+// Matches the start of a file against known signatures, picked by a jump
+// table on the first byte.
+MagicType classify_magic(const char*, uint64_t);
+
+// executables, archives, documents and scripts, kept even when declared as
+// something harmless
+bool is_wanted_magic(MagicType);
+
+// images, audio and video, not worth collecting any further
+bool is_unwanted_magic(MagicType);
+
+// the mime type the content really has, empty when unknown
+const char* get_magic_mime_type(MagicType);
+
+}
+}
+
+#endif //CUCKOOSNIFFER_UTIL_MAGIC_HPP
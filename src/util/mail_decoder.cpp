@@ -0,0 +1,170 @@
+#include "util/mail_decoder.hpp"
+
+namespace cs {
+namespace util {
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+QuotedPrintableDecoder::QuotedPrintableDecoder() :
+        pending_len_(0),
+        error_(false) {}
+
+uint64_t QuotedPrintableDecoder::feed(const char* data, uint64_t len, char* out) {
+    char* begin = out;
+    for (uint64_t i = 0; i < len; ++i) {
+        char c = data[i];
+        if (pending_len_ == 0) {
+            if (c == '=')
+                pending_[pending_len_++] = c;
+            else
+                *out++ = c;
+            continue;
+        }
+
+        if (pending_len_ == 1) {
+            //soft line break, CRLF or a bare LF
+            if (c == '\n') {
+                pending_len_ = 0;
+            }
+            else if (c != '\r') {
+                pending_[pending_len_++] = c;
+            }
+            continue;
+        }
+
+        int hi = hex_value(pending_[1]);
+        int lo = hex_value(c);
+        if (hi >= 0 && lo >= 0) {
+            *out++ = static_cast<char>(hi * 16 + lo);
+        }
+        else {
+            error_ = true;
+            *out++ = pending_[0];
+            *out++ = pending_[1];
+            *out++ = c;
+        }
+        pending_len_ = 0;
+    }
+    return out - begin;
+}
+
+uint64_t QuotedPrintableDecoder::finish(char* out) {
+    for (int i = 0; i < pending_len_; ++i) {
+        out[i] = pending_[i];
+    }
+    uint64_t size = static_cast<uint64_t>(pending_len_);
+    if (pending_len_ > 1)
+        error_ = true;
+    pending_len_ = 0;
+    return size;
+}
+
+bool QuotedPrintableDecoder::is_error() const {
+    return error_;
+}
+
+uint64_t QuotedPrintableDecoder::max_output(uint64_t len) {
+    //a bad escape held back from the last feed comes out with this one
+    return len + 2;
+}
+
+UuDecoder::UuDecoder() :
+        line_buffer_(MAX_LINE_SIZE),
+        begun_(false),
+        finished_(false),
+        error_(false) {}
+
+uint64_t UuDecoder::feed(const char* data, uint64_t len, char* out) {
+    char* begin = out;
+    StringView line;
+    while (!finished_ && line_buffer_.next(data, len, line)) {
+        if (!begun_) {
+            begun_ = parse_begin_line(line, name_);
+        }
+        else if (line.equals_nocase("end")) {
+            finished_ = true;
+        }
+        else {
+            out += decode_line(line, out);
+        }
+    }
+    if (line_buffer_.has_overflowed())
+        error_ = true;
+    return out - begin;
+}
+
+uint64_t UuDecoder::decode_line(StringView line, char* out) {
+    if (line.empty())
+        return 0;
+    //the first character is the decoded length, ` stands for 0
+    uint64_t size = static_cast<uint64_t>((line.data[0] - ' ') & 0x3f);
+    uint64_t groups = (size + 2) / 3;
+    //trailing spaces are often stripped, missing characters decode to zero
+    if (line.size + 3 < 1 + groups * 4) {
+        error_ = true;
+        return 0;
+    }
+
+    uint64_t written = 0;
+    for (uint64_t g = 0; g < groups; ++g) {
+        uint32_t quantum = 0;
+        for (uint64_t k = 0; k < 4; ++k) {
+            uint64_t pos = 1 + g * 4 + k;
+            char c = pos < line.size ? line.data[pos] : ' ';
+            quantum = quantum << 6 | static_cast<uint32_t>((c - ' ') & 0x3f);
+        }
+        for (int k = 0; k < 3 && written < size; ++k) {
+            out[written++] = static_cast<char>(quantum >> (16 - 8 * k));
+        }
+    }
+    return written;
+}
+
+uint64_t UuDecoder::finish(char*) {
+    if (begun_ && !finished_)
+        error_ = true;
+    return 0;
+}
+
+const std::string& UuDecoder::get_name() const {
+    return name_;
+}
+
+bool UuDecoder::is_begun() const {
+    return begun_;
+}
+
+bool UuDecoder::is_finished() const {
+    return finished_;
+}
+
+bool UuDecoder::is_error() const {
+    return error_;
+}
+
+bool UuDecoder::parse_begin_line(StringView line, std::string& name) {
+    //begin 644 name
+    Command command = parse_command(line);
+    uint64_t mode;
+    StringView argument = command.argument;
+    if (!command.verb.equals_nocase("begin") || !parse_uint(next_token(argument), mode))
+        return false;
+    name = argument.to_string();
+    return true;
+}
+
+uint64_t UuDecoder::max_output(uint64_t len) {
+    //a line held back from the last feed is decoded with this one
+    return (len + MAX_LINE_SIZE) / 4 * 3 + 3;
+}
+
+}
+}
@@ -0,0 +1,89 @@
+#ifndef CUCKOOSNIFFER_UTIL_MAIL_DECODER_HPP
+#define CUCKOOSNIFFER_UTIL_MAIL_DECODER_HPP
+
+#include <string>
+#include <cstdint>
+
+#include "util/line_buffer.hpp"
+
+namespace cs {
+namespace util {
+
+// Decodes quoted-printable as it arrives in pieces of any size, an escape
+// or soft line break cut by a piece boundary is completed on the next feed.
+class QuotedPrintableDecoder {
+
+public:
+
+    QuotedPrintableDecoder();
+
+    // writes the decoded bytes, the output needs max_output() of the input
+    // length, returns the bytes written
+    uint64_t feed(const char*, uint64_t, char*);
+
+    // flushes a cut escape as it is
+    uint64_t finish(char*);
+
+    // escapes that are not hex, they are kept as they are
+    bool is_error() const;
+
+    static uint64_t max_output(uint64_t);
+
+private:
+
+    //an escape seen so far, '=' and up to one more character
+    char pending_[2];
+    int pending_len_;
+
+    bool error_;
+
+};
+
+// Decodes the uuencoded file between "begin <mode> <name>" and "end",
+// lines before the begin line are skipped.
+class UuDecoder {
+
+public:
+
+    UuDecoder();
+
+    uint64_t feed(const char*, uint64_t, char*);
+
+    // nothing is held back, a missing end line is an error
+    uint64_t finish(char*);
+
+    // the name from the begin line, empty before it
+    const std::string& get_name() const;
+
+    bool is_begun() const;
+
+    bool is_finished() const;
+
+    // encoded lines that are too long or do not match their length
+    bool is_error() const;
+
+    static uint64_t max_output(uint64_t);
+
+    // the name of a "begin <mode> <name>" line, false for any other line
+    static bool parse_begin_line(StringView, std::string&);
+
+    static const uint64_t MAX_LINE_SIZE = 1024;
+
+private:
+
+    uint64_t decode_line(StringView, char*);
+
+    LineBuffer line_buffer_;
+
+    std::string name_;
+
+    bool begun_;
+    bool finished_;
+    bool error_;
+
+};
+
+}
+}
+
+#endif //CUCKOOSNIFFER_UTIL_MAIL_DECODER_HPP
@@ -1,176 +1,250 @@
 #include "util/mail_process.hpp"
 
-#include <iostream>
-#include <sstream>
-#include <map>
-#include <regex>
+#include <cstring>
 #include <set>
+#include <vector>
 
+#include "cuckoo_sniffer.hpp"
+#include "threads/task_group.hpp"
+#include "util/base64.hpp"
 #include "util/file.hpp"
+#include "util/magic.hpp"
+#include "util/mail_decoder.hpp"
+#include "util/mime.hpp"
+#include "util/search.hpp"
 
 namespace cs {
 namespace util {
 
-std::string match(const std::string &s, const std::regex &re) {
-    std::smatch match;
-    if (std::regex_search(s, match, re) && match.size() > 1) {
-        return match.str(1);
+static const std::set<std::string> target_file_type = {
+        "application/octet-stream",
+        "application/zip",
+        "application/x-msdownload",
+        "text/x-script.phyton"
+};
+
+//encoded messages inside messages are decoded and walked up to this depth
+static const int MAX_MESSAGE_DEPTH = 8;
+
+static const uint64_t SLICE_SIZE = 64 * 1024;
+
+//encoded input enough for MAGIC_HEADER_SIZE bytes in any of the encodings
+static const uint64_t MAGIC_INPUT_SIZE = 2048;
+
+//smaller parts are not worth a trip through the data queue
+static const uint64_t MIN_PARALLEL_SIZE = 256 * 1024;
+
+static bool is_uuencoding(const std::string& encoding) {
+    return encoding == "x-uuencode" || encoding == "uuencode" || encoding == "x-uue";
+}
+
+static void append(File* f, const char* data, uint64_t len) {
+    f -> write(data, len);
+}
+
+static void append(std::string& str, const char* data, uint64_t len) {
+    str.append(data, len);
+}
+
+//a slice at a time through one decoder into one output, returns false on malformed input
+template <typename Decoder, typename Output>
+static bool decode(Decoder& decoder, const char* data, uint64_t len, Output& out) {
+    std::vector<char> slice(Decoder::max_output(len < SLICE_SIZE ? len : SLICE_SIZE));
+    for (uint64_t pos = 0; pos < len; pos += SLICE_SIZE) {
+        uint64_t slice_len = len - pos < SLICE_SIZE ? len - pos : SLICE_SIZE;
+        append(out, slice.data(), decoder.feed(data + pos, slice_len, slice.data()));
+    }
+    append(out, slice.data(), decoder.finish(slice.data()));
+    return !decoder.is_error();
+}
+
+//a run of a part body without its transfer encoding, false if the encoding is unknown
+template <typename Output>
+static bool decode_range(const char* body, uint64_t len, const MimePart& part, Output& out, bool& clean) {
+    clean = true;
+    if (part.transfer_encoding == "base64") {
+        Base64Decoder decoder;
+        clean = decode(decoder, body, len, out);
+    }
+    else if (part.transfer_encoding == "quoted-printable") {
+        QuotedPrintableDecoder decoder;
+        clean = decode(decoder, body, len, out);
+    }
+    else if (is_uuencoding(part.transfer_encoding)) {
+        UuDecoder decoder;
+        clean = decode(decoder, body, len, out);
+    }
+    else if (part.is_identity_encoded()) {
+        append(out, body, len);
     }
     else {
-        return "";
+        return false;
     }
+    return true;
 }
 
-bool is_boundary(const std::string &line, const std::string &boundary) {
-    return line.find(boundary) != std::string::npos;
+//the body of a part without its transfer encoding, false if the encoding is unknown
+template <typename Output>
+static bool decode_body(const char* data, const MimePart& part, Output& out) {
+    bool clean;
+    if (!decode_range(data + part.body_begin, part.body_end - part.body_begin, part, out, clean)) {
+        LOG_DEBUG << "Mail part " << part.file_name << " encoding "
+                  << part.transfer_encoding << " not handled.";
+        return false;
+    }
+    if (!clean)
+        LOG_DEBUG << "Mail part " << part.file_name << " has malformed " << part.transfer_encoding << ".";
+    return true;
 }
 
-std::vector<File *> mail_process(const std::string &data) {
+//what the first bytes of a part say it is, decoded from a bounded prefix
+static MagicType sniff_part(const char* data, const MimePart& part) {
+    uint64_t len = part.body_end - part.body_begin;
+    std::string prefix;
+    bool clean;
+    decode_range(data + part.body_begin, len < MAGIC_INPUT_SIZE ? len : MAGIC_INPUT_SIZE, part, prefix, clean);
+    return classify_magic(prefix.data(), prefix.size() < MAGIC_HEADER_SIZE ? prefix.size() : MAGIC_HEADER_SIZE);
+}
 
-    std::istringstream input_stream(data.c_str());
+static void add_file(File* f, std::vector<File *>& file_vec) {
+    //hashed here so the digest is worked out on the thread that decoded the part
+    f -> get_digest();
+    file_vec.push_back(f);
+}
 
-    std::multimap<std::string, std::string> record;
+//files uuencoded into the text of a message, as old clients send them
+static void extract_inline_uuencode(const char* data, const MimePart& part, std::vector<File *>& file_vec) {
+    const char* body = data + part.body_begin;
+    uint64_t len = part.body_end - part.body_begin;
+    const char* found = len >= 6 && memcmp(body, "begin ", 6) == 0 ? body : find_bytes(body, len, "\nbegin ", 7);
+
+    while (found != nullptr) {
+        uint64_t pos = found - body + (*found == '\n' ? 1 : 0);
+
+        //only a block whose own begin line parses is decoded, so no block is found twice
+        const char* line_end = static_cast<const char*>(memchr(body + pos, '\n', len - pos));
+        uint64_t line_len = line_end == nullptr ? len - pos : line_end - body - pos;
+        if (line_len > 0 && body[pos + line_len - 1] == '\r')
+            --line_len;
+        std::string name;
+        if (!UuDecoder::parse_begin_line(StringView(body + pos, line_len), name)) {
+            found = find_bytes(body + pos, len - pos, "\nbegin ", 7);
+            continue;
+        }
 
-    //based on RFC5321
+        UuDecoder decoder;
+        File *f = new File();
+        decode(decoder, body + pos, len - pos, f);
+        if (decoder.is_begun() && f -> get_size() > 0) {
+            f -> set_name(decoder.get_name());
+            f -> set_mime_type("application/octet-stream");
+            add_file(f, file_vec);
+        }
+        else {
+            delete f;
+        }
+        if (!decoder.is_finished())
+            break;
+        found = find_bytes(body + pos, len - pos, "\nbegin ", 7);
+    }
+}
 
+static void extract_files(const char*, const MimePart&, int, std::vector<File *>&);
 
-    static const std::set<std::string> target_file_type = {
-            "application/octet-stream",
-            "application/zip",
-            "application/x-msdownload",
-            "text/x-script.phyton"
-    };
+static void collect_leaves(const MimePart& part, std::vector<const MimePart*>& leaves) {
+    for (const auto& child: part.children) {
+        collect_leaves(child, leaves);
+    }
+    if (part.children.empty())
+        leaves.push_back(&part);
+}
 
-    static const std::regex hello_command("(?:EHLO|HELO) (\\S+)");
-    static const std::regex auth_command("AUTH PLAIN (\\S+)");
-    static const std::regex mail_command("(?:MAIL|mail) FROM\\:\\s*(\\S+)");
-    static const std::regex rcpt_command("(?:RCPT|rcpt) TO\\:\\s*(\\S+)");
-    static const std::regex date_command("Date: (.+)");
-    static const std::regex ua_command("User-Agent: (.+)");
-    static const std::regex boundary_command("boundary=\"([\\w_=\\.-]+)\"");
-    static const std::regex content_type_command("Content-[Tt]ype:\\s*([-/\\w]+)");
-    static const std::regex name_command("name=\"([-\\=\\+\?\\w\\.]+)\"");
-    static const std::regex encoding_command("Content-[Tt]ransfer-[Ee]ncoding: (\\w+)");
-    static const std::regex quit_command("(QUIT)");
+static void extract_leaf(const char* data, const MimePart& part, int depth, std::vector<File *>& file_vec) {
+    //forwarded messages that were encoded as a whole are decoded and walked
+    if (part.is_message()) {
+        std::string message;
+        if (depth < MAX_MESSAGE_DEPTH && decode_body(data, part, message)) {
+            MimePart embedded = parse_mime(message.data(), message.size());
+            extract_files(message.data(), embedded, depth + 1, file_vec);
+        }
+        return;
+    }
 
-    bool have_boundary = false;
-    bool file_section = false;
-    std::string line, s, boundary;
-    std::string file_mime_type, file_name, file_encoding;
+    //declared types lie, what the content starts with decides first
+    MagicType magic = sniff_part(data, part);
+    if (is_unwanted_magic(magic)) {
+        LOG_DEBUG << "Mail part " << part.file_name << " declared " << part.media_type
+                  << " is " << get_magic_mime_type(magic) << ", skipped.";
+        return;
+    }
 
-    std::vector<File *> file_vec;
+    //attachments and the types we look for
+    if (part.file_name.empty() && !is_wanted_magic(magic) &&
+            target_file_type.find(part.media_type) == target_file_type.end()) {
+        if (part.media_type == "text/plain" && part.is_identity_encoded())
+            extract_inline_uuencode(data, part, file_vec);
+        return;
+    }
 
-    try {
+    File *f = new File();
+    f -> set_name(part.file_name);
+    f -> set_mime_type(is_wanted_magic(magic) ? get_magic_mime_type(magic) : part.media_type);
+    //decoded straight into the file, sized for the common encodings up front
+    uint64_t len = part.body_end - part.body_begin;
+    f -> set_size(part.transfer_encoding == "base64" ? len / 4 * 3 : len);
+    if (decode_body(data, part, f))
+        add_file(f, file_vec);
+    else
+        delete f;
+}
 
-        //read email headers
-        while (std::getline(input_stream, line)) {
-            if ((s = match(line, hello_command)) != "") {
-                record.insert(std::make_pair("domin", s));
-            }
-            if ((s = match(line, auth_command)) != "") {
-                record.insert(std::make_pair("auth_info", s));
-            }
-            if ((s = match(line, mail_command)) != "") {
-                record.insert(std::make_pair("sender_address", s));
-            }
-            if ((s = match(line, rcpt_command)) != "") {
-                record.insert(std::make_pair("receiver_address", s));
-            }
-            if ((s = match(line, date_command)) != "") {
-                record.insert(std::make_pair("date", s));
-            }
-            if ((s = match(line, ua_command)) != "") {
-                record.insert(std::make_pair("user_agent", s));
-            }
-            if ((s = match(line, boundary_command)) != "") {
-                boundary = s;
-                have_boundary = true;
-//                std::cout << "get boundary  " << s << std::endl;
-                break;
+//the parts are independent once indexed, large ones are decoded and hashed
+//on the worker threads and gathered back in message order
+static void extract_files(const char* data, const MimePart& part, int depth, std::vector<File *>& file_vec) {
+    std::vector<const MimePart*> leaves;
+    collect_leaves(part, leaves);
+
+    std::vector<std::vector<File *>> results(leaves.size());
+    {
+        threads::TaskGroup group;
+        for (uint64_t i = 0; i < leaves.size(); ++i) {
+            const MimePart& leaf = *leaves[i];
+            std::vector<File *>& result = results[i];
+            if (leaf.body_end - leaf.body_begin < MIN_PARALLEL_SIZE) {
+                extract_leaf(data, leaf, depth, result);
+                continue;
             }
+            group.run([data, &leaf, depth, &result]() {
+                extract_leaf(data, leaf, depth, result);
+            });
         }
-        for (const auto &iter: record) {
-            std::cout << iter.first << ":" << iter.second << std::endl;
-        }
+        group.wait();
+    }
 
-        //find the first boundary
-        while (std::getline(input_stream, line)) {
-            if (is_boundary(line, boundary)) {
-                break;
-            }
-        }
-        while (true) {
-            //init
-            file_mime_type = file_name = file_encoding = "";
-
-            //now line is boundary
-            while (std::getline(input_stream, line)) {
-                if (line == "" || line == "\r") {
-                    break;
-                }
-                if (file_mime_type == "")
-                    file_mime_type = match(line, content_type_command);
-                if (file_name == "")
-                    file_name = match(line, name_command);
-                if (file_encoding == "")
-                    file_encoding = match(line, encoding_command);
-            }
+    for (const auto& result: results) {
+        file_vec.insert(file_vec.end(), result.begin(), result.end());
+    }
+}
 
-            if (file_mime_type == "" && file_name == "" && file_encoding == "") {
-                break;
-            }
+std::vector<File *> mail_process(const std::string &data) {
 
-            if (target_file_type.find(file_mime_type) == target_file_type.end()) {
-                //not in file section, go to next boundary
-                while (std::getline(input_stream, line)) {
-                    if (is_boundary(line, boundary)) {
-                        break;
-                    }
-                }
-                continue;
-            }
+    std::vector<File *> file_vec;
 
-            File *f = new File();
-            f -> set_name(file_name);
-            f -> set_mime_type(file_mime_type);
-            f -> set_mime_type(file_encoding);
-
-
-            if (file_encoding == "base64") {
-                while (true) {
-//                            std::getline(input_stream, line);
-                    input_stream >> line;
-                    if (is_boundary(line, boundary)) {
-                        char ch;
-                        do {
-                            ch = '\0';
-                            input_stream.get(ch);
-                        } while (ch == '\n' || ch == '\r');
-                        input_stream.putback(ch);
-                        break;
-                    }
-                    if (line == "" || line == "\r") {
-                        continue;
-                    }
-                    else {
-                        f->write(line.c_str(), line.size());
-                    }
-                }
-                std::cout << f->get_name() << std::endl;
-                std::cout << f->get_mime_type() << std::endl;
-                std::cout << "size: " << f->get_size() << std::endl << std::endl;
-                file_vec.push_back(f);
-            }
-            else {
+    MimePart message = parse_mime(data.data(), data.size());
 
-            }
+    LOG_INFO << "Mail date " << unfold_header(message.get_header("Date"));
+    LOG_INFO << "Mail user agent " << unfold_header(message.get_header("User-Agent"));
 
-        }
-    }
-    catch (std::exception e) {
+    extract_files(data.data(), message, 0, file_vec);
+
+    for (File* f: file_vec) {
+        LOG_INFO << "Mail file name " << f -> get_name();
+        LOG_INFO << "Mail file type " << f -> get_mime_type();
+        LOG_INFO << "Mail file size " << f -> get_size();
+        LOG_INFO << "Mail file md5 " << f -> get_md5();
     }
     return file_vec;
 }
 
 }
-}
\ No newline at end of file
+}
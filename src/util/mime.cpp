@@ -0,0 +1,278 @@
+#include "util/mime.hpp"
+
+#include <cstring>
+#include <strings.h>
+
+#include "util/search.hpp"
+
+namespace cs {
+namespace util {
+
+namespace {
+
+const int MAX_DEPTH = 16;
+
+const uint64_t MAX_PARTS = 1024;
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+StringView trim(StringView str) {
+    while (!str.empty() && is_space(str.data[0]))
+        str = str.substr(1);
+    while (!str.empty() && is_space(str.data[str.size - 1]))
+        --str.size;
+    return str;
+}
+
+std::string to_lower(StringView str) {
+    std::string ret = str.to_string();
+    for (char& c: ret) {
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+    }
+    return ret;
+}
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+//charset'language'percent-encoded, the charset is not converted
+std::string decode_extended(const std::string& value, bool first) {
+    size_t begin = 0;
+    if (first) {
+        size_t quote = value.find('\'');
+        size_t second = quote == std::string::npos ? quote : value.find('\'', quote + 1);
+        if (second != std::string::npos)
+            begin = second + 1;
+    }
+    std::string ret;
+    for (size_t i = begin; i < value.size(); ++i) {
+        if (value[i] == '%' && i + 2 < value.size() &&
+                hex_value(value[i + 1]) >= 0 && hex_value(value[i + 2]) >= 0) {
+            ret += static_cast<char>(hex_value(value[i + 1]) * 16 + hex_value(value[i + 2]));
+            i += 2;
+        }
+        else {
+            ret += value[i];
+        }
+    }
+    return ret;
+}
+
+//position of the next "--boundary" at a line start, end if there is none
+uint64_t find_delimiter(const char* data, uint64_t pos, uint64_t end, const std::string& delimiter) {
+    if (pos == 0 || data[pos - 1] == '\n') {
+        if (end - pos >= delimiter.size() && memcmp(data + pos, delimiter.data(), delimiter.size()) == 0)
+            return pos;
+    }
+    std::string pattern = "\n" + delimiter;
+    const char* found = find_bytes(data + pos, end - pos, pattern.data(), pattern.size());
+    return found == nullptr ? end : found - data + 1;
+}
+
+uint64_t line_end(const char* data, uint64_t pos, uint64_t end) {
+    const void* found = memchr(data + pos, '\n', end - pos);
+    return found == nullptr ? end : static_cast<const char*>(found) - data + 1;
+}
+
+void parse_part(const char* data, uint64_t begin, uint64_t end, int depth, uint64_t& parts, MimePart& part);
+
+void parse_headers(const char* data, uint64_t begin, uint64_t end, MimePart& part) {
+    part.header_begin = begin;
+    uint64_t pos = begin;
+    while (pos < end) {
+        uint64_t next = line_end(data, pos, end);
+        StringView line(data + pos, next - pos);
+        while (!line.empty() && (line.data[line.size - 1] == '\n' || line.data[line.size - 1] == '\r'))
+            --line.size;
+
+        if (line.empty()) {
+            pos = next;
+            break;
+        }
+        if ((line.data[0] == ' ' || line.data[0] == '\t') && !part.headers.empty()) {
+            //folded, the value runs on to the end of this line
+            StringView& value = part.headers.back().second;
+            value.size = line.data + line.size - value.data;
+        }
+        else {
+            uint64_t colon = line.find(':');
+            if (colon < line.size)
+                part.headers.emplace_back(trim(line.substr(0, colon)), trim(line.substr(colon + 1)));
+        }
+        pos = next;
+    }
+    part.body_begin = pos;
+    part.body_end = end;
+}
+
+void split_multipart(const char* data, int depth, uint64_t& parts, MimePart& part) {
+    std::string delimiter = "--" + part.boundary;
+    uint64_t end = part.body_end;
+    uint64_t pos = find_delimiter(data, part.body_begin, end, delimiter);
+
+    while (pos < end && parts < MAX_PARTS) {
+        uint64_t after = pos + delimiter.size();
+        //the close delimiter ends the multipart, what follows is epilogue
+        if (end - after >= 2 && data[after] == '-' && data[after + 1] == '-')
+            break;
+
+        uint64_t part_begin = line_end(data, after, end);
+        uint64_t next = find_delimiter(data, part_begin, end, delimiter);
+        //the line break before a delimiter belongs to it
+        uint64_t part_end = next;
+        if (next < end) {
+            if (part_end > part_begin && data[part_end - 1] == '\n')
+                --part_end;
+            if (part_end > part_begin && data[part_end - 1] == '\r')
+                --part_end;
+        }
+
+        part.children.emplace_back();
+        ++parts;
+        parse_part(data, part_begin, part_end, depth + 1, parts, part.children.back());
+        pos = next;
+    }
+}
+
+void parse_part(const char* data, uint64_t begin, uint64_t end, int depth, uint64_t& parts, MimePart& part) {
+    parse_headers(data, begin, end, part);
+
+    std::string content_type = unfold_header(part.get_header("Content-Type"));
+    StringView type(content_type);
+    part.media_type = to_lower(trim(type.substr(0, type.find(';'))));
+    if (part.media_type.empty())
+        part.media_type = "text/plain";
+
+    std::string disposition = unfold_header(part.get_header("Content-Disposition"));
+    part.file_name = get_mime_parameter(disposition, "filename");
+    if (part.file_name.empty())
+        part.file_name = get_mime_parameter(content_type, "name");
+
+    part.transfer_encoding = to_lower(trim(part.get_header("Content-Transfer-Encoding")));
+
+    if (depth >= MAX_DEPTH)
+        return;
+    if (part.media_type.compare(0, 10, "multipart/") == 0) {
+        part.boundary = get_mime_parameter(content_type, "boundary");
+        if (!part.boundary.empty())
+            split_multipart(data, depth, parts, part);
+    }
+    else if (part.is_message() && part.is_identity_encoded() && parts < MAX_PARTS) {
+        //an embedded message in the clear is parsed in place, encoded ones
+        //have to be decoded first
+        part.children.emplace_back();
+        ++parts;
+        parse_part(data, part.body_begin, part.body_end, depth + 1, parts, part.children.back());
+    }
+}
+
+}
+
+StringView MimePart::get_header(const char* name) const {
+    for (const auto& header: headers) {
+        if (header.first.equals_nocase(name))
+            return header.second;
+    }
+    return StringView();
+}
+
+bool MimePart::is_message() const {
+    return media_type == "message/rfc822" || media_type == "message/global";
+}
+
+bool MimePart::is_identity_encoded() const {
+    return transfer_encoding.empty() || transfer_encoding == "7bit" ||
+           transfer_encoding == "8bit" || transfer_encoding == "binary";
+}
+
+MimePart parse_mime(const char* data, uint64_t len) {
+    MimePart root;
+    uint64_t parts = 1;
+    parse_part(data, 0, len, 0, parts, root);
+    return root;
+}
+
+std::string unfold_header(StringView value) {
+    std::string ret;
+    ret.reserve(value.size);
+    for (uint64_t i = 0; i < value.size; ++i) {
+        char c = value.data[i];
+        if (c == '\r' || c == '\n') {
+            //the line break and the indentation after it become one space
+            while (i + 1 < value.size && is_space(value.data[i + 1]))
+                ++i;
+            ret += ' ';
+        }
+        else {
+            ret += c;
+        }
+    }
+    return ret;
+}
+
+std::string get_mime_parameter(const std::string& value, const char* name) {
+    size_t name_len = strlen(name);
+    std::string plain;
+    std::string extended;
+    bool found_plain = false;
+    bool found_extended = false;
+
+    size_t pos = value.find(';');
+    while (pos != std::string::npos) {
+        size_t begin = value.find_first_not_of(" \t", pos + 1);
+        if (begin == std::string::npos)
+            break;
+        size_t equal = value.find('=', begin);
+        if (equal == std::string::npos)
+            break;
+
+        std::string param_name = trim(StringView(value).substr(begin, equal - begin)).to_string();
+        std::string param_value;
+        size_t i = value.find_first_not_of(" \t", equal + 1);
+        if (i != std::string::npos && value[i] == '"') {
+            for (++i; i < value.size() && value[i] != '"'; ++i) {
+                if (value[i] == '\\' && i + 1 < value.size())
+                    ++i;
+                param_value += value[i];
+            }
+            pos = value.find(';', i);
+        }
+        else {
+            pos = value.find(';', equal);
+            param_value = trim(StringView(value).substr(equal + 1,
+                    pos == std::string::npos ? std::string::npos : pos - equal - 1)).to_string();
+        }
+
+        //name, name*, name*0, name*0*, name*1 ...
+        if (param_name.size() < name_len || strncasecmp(param_name.c_str(), name, name_len) != 0)
+            continue;
+        std::string suffix = param_name.substr(name_len);
+        if (suffix.empty()) {
+            plain = param_value;
+            found_plain = true;
+        }
+        else if (suffix[0] == '*') {
+            bool encoded = suffix.back() == '*';
+            bool first = suffix == "*" || suffix == "*0" || suffix == "*0*";
+            //continuations are expected in order
+            extended += encoded ? decode_extended(param_value, first) : param_value;
+            found_extended = true;
+        }
+    }
+    if (found_extended)
+        return extended;
+    return found_plain ? plain : "";
+}
+
+}
+}
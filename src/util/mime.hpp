@@ -0,0 +1,62 @@
+#ifndef CUCKOOSNIFFER_UTIL_MIME_HPP
+#define CUCKOOSNIFFER_UTIL_MIME_HPP
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+#include "util/tokenizer.hpp"
+
+namespace cs {
+namespace util {
+
+// One node of a parsed MIME message. Headers and offsets point into the
+// parsed buffer, which has to outlive the tree. Header values are raw, a
+// folded value still holds its line breaks.
+struct MimePart {
+
+    uint64_t header_begin = 0;
+    uint64_t body_begin = 0;
+    uint64_t body_end = 0;
+
+    std::vector<std::pair<StringView, StringView> > headers;
+
+    // lowercased, text/plain when there is no Content-Type
+    std::string media_type;
+    std::string boundary;
+    // from Content-Disposition, else the name of Content-Type
+    std::string file_name;
+    // lowercased, empty for 7bit
+    std::string transfer_encoding;
+
+    std::vector<MimePart> children;
+
+    // first field of that name, case-insensitive, empty if it is missing
+    StringView get_header(const char*) const;
+
+    // message/rfc822 or message/global
+    bool is_message() const;
+
+    // 7bit, 8bit, binary or none
+    bool is_identity_encoded() const;
+
+};
+
+// Cuts a whole message into its part tree in one pass over the buffer,
+// multiparts are split by searching their delimiters. Embedded messages
+// that are not transfer encoded become the only child of their part.
+MimePart parse_mime(const char*, uint64_t);
+
+// a folded header value on one line
+std::string unfold_header(StringView);
+
+// value of a parameter of a structured field, mail or HTTP, unquoted, RFC
+// 2231 extended and continued values joined and percent-decoded, empty if
+// it is missing
+std::string get_mime_parameter(const std::string&, const char*);
+
+}
+}
+
+#endif //CUCKOOSNIFFER_UTIL_MIME_HPP
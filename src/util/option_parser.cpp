@@ -13,13 +13,25 @@ namespace cs {
 namespace util {
 
 
-const int k_HELP_DESC_NUM = 4;
+const int k_HELP_DESC_NUM = 16;
 
 const char* k_HELP_DESC[k_HELP_DESC_NUM][2] = {
         {"help,h",                      "help message"                  },
         {"config-file,c",               "set compression level"         },
         {"interface",                   "set client's ip bind address"  },
         {"submit_url",                  "set client's ip bind address"  },
+        {"smb_skip_signed",             "abandon signed SMB sessions (true/false)"      },
+        {"smb_pipe_only_limit",         "abandon SMB connections after this many pipe-only messages, 0 to disable"  },
+        {"smb_idle_timeout",            "emit open SMB files after this many seconds without I/O, off (0) by default" },
+        {"smb_emit_ratio",              "emit open SMB files once this share of the file size is seen, off (0) by default" },
+        {"http_capture_types",          "comma separated content type prefixes of HTTP downloads to keep"          },
+        {"http_capture_min_size",       "smallest HTTP download to keep, in bytes"                                 },
+        {"http_capture_max_size",       "largest HTTP download to keep, in bytes"                                  },
+        {"http_range_idle_timeout",     "emit partly fetched HTTP range objects after this many seconds, 0 to disable" },
+        {"http_max_decode_ratio",       "give up decompressing HTTP bodies that expand more than this"             },
+        {"ftp_expect_timeout",          "forget announced FTP data connections not opened within this many seconds" },
+        {"file_map_threshold",          "keep files larger than this many bytes in memfd mappings, 0 to disable"   },
+        {"file_huge_pages",             "back mapped files with reserved huge pages (true/false)"                  },
 };
 
 void parse_variables_to_map(std::map<std::string, std::string>& m, const boost::program_options::variables_map& vm) {
@@ -34,10 +46,11 @@ int parse_cfg(int& argc, const char** &argv, std::map<std::string, std::string>&
 
     boost::program_options::options_description desc("Allowed options");
     desc.add_options()
-            (k_HELP_DESC[0 ][0],                                               k_HELP_DESC[0][1])
-            (k_HELP_DESC[1 ][0], boost::program_options::value<std::string>(), k_HELP_DESC[1 ][1])
-            (k_HELP_DESC[2 ][0], boost::program_options::value<std::string>(), k_HELP_DESC[2 ][1])
-            (k_HELP_DESC[3 ][0], boost::program_options::value<std::string>(), k_HELP_DESC[3 ][1]);
+            (k_HELP_DESC[0 ][0],                                               k_HELP_DESC[0][1]);
+    for (int i = 1; i < k_HELP_DESC_NUM; ++i) {
+        desc.add_options()
+                (k_HELP_DESC[i][0], boost::program_options::value<std::string>(), k_HELP_DESC[i][1]);
+    }
 
     boost::program_options::positional_options_description p;
     p.add("interface", -1);
@@ -0,0 +1,148 @@
+#include "util/search.hpp"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CS_SEARCH_X86
+#include <immintrin.h>
+#endif
+
+namespace cs {
+namespace util {
+
+typedef const char* (*find_function)(const char*, uint64_t, const char*, uint64_t);
+
+static const char* find_scalar(
+        const char* data,
+        uint64_t len,
+        const char* pattern,
+        uint64_t pattern_len) {
+
+    const char* p = data;
+    const char* end = data + len - pattern_len + 1;
+    while (p < end) {
+        p = static_cast<const char*>(memchr(p, pattern[0], end - p));
+        if (p == nullptr)
+            return nullptr;
+        if (memcmp(p, pattern, pattern_len) == 0)
+            return p;
+        ++p;
+    }
+    return nullptr;
+}
+
+#ifdef CS_SEARCH_X86
+
+//compare the first and the last byte of the pattern a block at a time,
+//only candidates matching both are checked in full
+
+__attribute__((target("sse2")))
+static const char* find_sse2(
+        const char* data,
+        uint64_t len,
+        const char* pattern,
+        uint64_t pattern_len) {
+
+    const __m128i first = _mm_set1_epi8(pattern[0]);
+    const __m128i last = _mm_set1_epi8(pattern[pattern_len - 1]);
+
+    uint64_t i = 0;
+    for (; i + pattern_len - 1 + 16 <= len; i += 16) {
+        __m128i block_first = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(data + i));
+        __m128i block_last = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(data + i + pattern_len - 1));
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(
+                _mm_cmpeq_epi8(first, block_first),
+                _mm_cmpeq_epi8(last, block_last)));
+        while (mask != 0) {
+            unsigned int bit = __builtin_ctz(mask);
+            if (memcmp(data + i + bit + 1, pattern + 1, pattern_len - 2) == 0)
+                return data + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return find_scalar(data + i, len - i, pattern, pattern_len);
+}
+
+__attribute__((target("avx2")))
+static const char* find_avx2(
+        const char* data,
+        uint64_t len,
+        const char* pattern,
+        uint64_t pattern_len) {
+
+    const __m256i first = _mm256_set1_epi8(pattern[0]);
+    const __m256i last = _mm256_set1_epi8(pattern[pattern_len - 1]);
+
+    uint64_t i = 0;
+    for (; i + pattern_len - 1 + 32 <= len; i += 32) {
+        __m256i block_first = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(data + i));
+        __m256i block_last = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(data + i + pattern_len - 1));
+        unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_and_si256(
+                _mm256_cmpeq_epi8(first, block_first),
+                _mm256_cmpeq_epi8(last, block_last))));
+        while (mask != 0) {
+            unsigned int bit = __builtin_ctz(mask);
+            if (memcmp(data + i + bit + 1, pattern + 1, pattern_len - 2) == 0)
+                return data + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return find_sse2(data + i, len - i, pattern, pattern_len);
+}
+
+#endif
+
+static find_function select_find() {
+#ifdef CS_SEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return find_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return find_sse2;
+#endif
+    return find_scalar;
+}
+
+const char* find_bytes(
+        const char* data,
+        uint64_t len,
+        const char* pattern,
+        uint64_t pattern_len) {
+
+    static const find_function find = select_find();
+
+    if (pattern_len == 0 || len < pattern_len)
+        return nullptr;
+    if (pattern_len == 1)
+        return static_cast<const char*>(memchr(data, pattern[0], len));
+    return find(data, len, pattern, pattern_len);
+}
+
+uint64_t partial_match(
+        const char* data,
+        uint64_t len,
+        const char* pattern,
+        uint64_t pattern_len) {
+
+    if (pattern_len == 0)
+        return 0;
+    uint64_t max = pattern_len - 1 < len ? pattern_len - 1 : len;
+    const char* p = data + len - max;
+    const char* end = data + len;
+    while (p < end) {
+        p = static_cast<const char*>(memchr(p, pattern[0], end - p));
+        if (p == nullptr)
+            return 0;
+        if (memcmp(p, pattern, end - p) == 0)
+            return end - p;
+        ++p;
+    }
+    return 0;
+}
+
+}
+}
@@ -0,0 +1,20 @@
+#ifndef CUCKOOSNIFFER_UTIL_SEARCH_HPP
+#define CUCKOOSNIFFER_UTIL_SEARCH_HPP
+
+#include <cstdint>
+
+namespace cs {
+namespace util {
+
+// First occurrence of a byte pattern, nullptr if there is none. Uses
+// AVX2 or SSE2 when the cpu has them and falls back to memchr otherwise.
+const char* find_bytes(const char*, uint64_t, const char*, uint64_t);
+
+// Length of the longest tail of the data that is a head of the pattern,
+// for matches cut by the end of a segment.
+uint64_t partial_match(const char*, uint64_t, const char*, uint64_t);
+
+}
+}
+
+#endif //CUCKOOSNIFFER_UTIL_SEARCH_HPP
@@ -0,0 +1,42 @@
+#include "util/statistics.hpp"
+
+#include "cuckoo_sniffer.hpp"
+
+namespace cs {
+namespace util {
+
+Statistics& STATISTICS = Statistics::get_instance();
+
+Statistics Statistics::instance;
+
+const char* Statistics::COUNTER_NAME[COUNTER_NUM] = {
+        "smtp_starttls",
+        "imap_starttls",
+};
+
+Statistics &Statistics::get_instance() {
+    return instance;
+}
+
+void Statistics::increase(Counter counter, uint64_t n) {
+    counters_[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t Statistics::get(Counter counter) const {
+    return counters_[counter].load(std::memory_order_relaxed);
+}
+
+void Statistics::log() const {
+    for (int i = 0; i < COUNTER_NUM; ++i) {
+        LOG_INFO << "Statistics " << COUNTER_NAME[i] << " " << get(static_cast<Counter>(i));
+    }
+}
+
+Statistics::Statistics() {
+    for (int i = 0; i < COUNTER_NUM; ++i) {
+        counters_[i].store(0);
+    }
+}
+
+}
+}
@@ -0,0 +1,46 @@
+#ifndef CUCKOOSNIFFER_UTIL_STATISTICS_HPP
+#define CUCKOOSNIFFER_UTIL_STATISTICS_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace cs {
+namespace util {
+
+// Process wide counters, safe to bump from the capture and worker threads.
+class Statistics {
+
+public:
+
+    enum Counter {
+        SMTP_STARTTLS,
+        IMAP_STARTTLS,
+        COUNTER_NUM
+    };
+
+    static Statistics instance;
+
+    static Statistics &get_instance();
+
+    void increase(Counter, uint64_t = 1);
+
+    uint64_t get(Counter) const;
+
+    void log() const;
+
+private:
+
+    static const char* COUNTER_NAME[COUNTER_NUM];
+
+    std::atomic<uint64_t> counters_[COUNTER_NUM];
+
+    Statistics();
+
+};
+
+extern Statistics& STATISTICS;
+
+}
+}
+
+#endif //CUCKOOSNIFFER_UTIL_STATISTICS_HPP
@@ -0,0 +1,79 @@
+#include "util/tokenizer.hpp"
+
+#include <cstring>
+#include <strings.h>
+
+namespace cs {
+namespace util {
+
+bool StringView::equals_nocase(const char* str) const {
+    return strlen(str) == size && strncasecmp(data, str, size) == 0;
+}
+
+bool StringView::starts_with_nocase(const char* str) const {
+    uint64_t len = strlen(str);
+    return len <= size && strncasecmp(data, str, len) == 0;
+}
+
+uint64_t StringView::find(char c, uint64_t pos) const {
+    if (pos >= size)
+        return size;
+    const void* found = memchr(data + pos, c, size - pos);
+    return found == nullptr ? size : static_cast<const char*>(found) - data;
+}
+
+StringView StringView::substr(uint64_t pos, uint64_t len) const {
+    if (pos > size)
+        pos = size;
+    if (len > size - pos)
+        len = size - pos;
+    return StringView(data + pos, len);
+}
+
+StringView next_token(StringView& str) {
+    uint64_t end = str.find(' ');
+    StringView token = str.substr(0, end);
+    while (end < str.size && str.data[end] == ' ')
+        ++end;
+    str = str.substr(end);
+    return token;
+}
+
+Command parse_command(StringView line) {
+    Command command;
+    command.verb = next_token(line);
+    command.argument = line;
+    return command;
+}
+
+Command parse_tagged_command(StringView line) {
+    Command command;
+    command.tag = next_token(line);
+    command.verb = next_token(line);
+    command.argument = line;
+    return command;
+}
+
+int lookup_verb(StringView verb, const char* const verbs[], int num) {
+    for (int i = 0; i < num; ++i) {
+        if (verb.equals_nocase(verbs[i]))
+            return i;
+    }
+    return num;
+}
+
+bool parse_uint(StringView str, uint64_t& value) {
+    if (str.empty())
+        return false;
+    value = 0;
+    for (uint64_t i = 0; i < str.size; ++i) {
+        char c = str.data[i];
+        if (c < '0' || c > '9' || value > (UINT64_MAX - 9) / 10)
+            return false;
+        value = value * 10 + (c - '0');
+    }
+    return true;
+}
+
+}
+}
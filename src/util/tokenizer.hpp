@@ -0,0 +1,62 @@
+#ifndef CUCKOOSNIFFER_UTIL_TOKENIZER_HPP
+#define CUCKOOSNIFFER_UTIL_TOKENIZER_HPP
+
+#include <string>
+#include <cstdint>
+
+namespace cs {
+namespace util {
+
+// Bytes owned by someone else, valid only as long as they are.
+struct StringView {
+
+    const char* data = nullptr;
+    uint64_t size = 0;
+
+    StringView() {}
+    StringView(const char* data, uint64_t size) : data(data), size(size) {}
+    StringView(const std::string& str) : data(str.data()), size(str.size()) {}
+
+    bool empty() const { return size == 0; }
+
+    std::string to_string() const { return std::string(data, size); }
+
+    bool equals_nocase(const char*) const;
+
+    bool starts_with_nocase(const char*) const;
+
+    // position of a byte, size if it is missing
+    uint64_t find(char, uint64_t = 0) const;
+
+    StringView substr(uint64_t, uint64_t = UINT64_MAX) const;
+
+};
+
+// A control channel line cut into its parts, the tag is set for IMAP only.
+struct Command {
+
+    StringView tag;
+    StringView verb;
+    StringView argument;
+
+};
+
+// next space separated token, the view is advanced past it and the spaces after
+StringView next_token(StringView&);
+
+// "VERB argument" of FTP and SMTP
+Command parse_command(StringView);
+
+// "tag VERB argument" of IMAP
+Command parse_tagged_command(StringView);
+
+// index of the verb in the table, case-insensitive, the table size if it is unknown
+int lookup_verb(StringView, const char* const[], int);
+
+// decimal digits only, false on anything else or overflow
+bool parse_uint(StringView, uint64_t&);
+
+}
+}
+
+#endif //CUCKOOSNIFFER_UTIL_TOKENIZER_HPP